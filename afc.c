@@ -11,6 +11,8 @@
 
 #include "gstiq.h"
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
 static GstElementDetails afc_details = GST_ELEMENT_DETAILS(
 	"AFC plugin",
@@ -23,6 +25,15 @@ enum {
 	ARG_0,
 	ARG_AFC,
 	ARG_MIRROR,
+	ARG_METHOD,
+	ARG_THRESHOLD,
+	ARG_BANDWIDTH,
+	ARG_CONTROL,
+};
+
+enum {
+	AFC_CENTROID,
+	AFC_PEAK,
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
@@ -52,17 +63,68 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 
 static GstElementClass *parent_class = NULL;
 
+/* Power of all bins, returns the strongest of the first 'n' */
+static int gst_afc_power(const float *in, float *power, int length, int n)
+{
+	float max = 0.0;
+	int i, peak = 0;
+
+	for (i = 0; i < length; i++)
+		power[i] = in[i*2] * in[i*2] + in[i*2+1] * in[i*2+1];
+	for (i = 0; i < n; i++) {
+		if (power[i] > max) {
+			max = power[i];
+			peak = i;
+		}
+	}
+	return peak;
+}
+
+/*
+ *	Estimated carrier in bins. Without 'mirror' the upper half of the
+ *	spectrum is the negative frequencies, with it only the lower half
+ *	is used.
+ *	The centroid is the power weighted mean of the bins within
+ *	'threshold' dB of the peak. The peak is refined by fitting a
+ *	Gaussian through it and its neighbours, for a Hann windowed sine
+ *	that is good to a few hundredths of a bin.
+ */
+static float gst_afc_estimate(Gst_afc *afc, const float *power, int peak)
+{
+	int n = afc->mirror ? afc->length / 2 : afc->length;
+	int len = afc->length;
+	float thr, sum = 0.0, integrate = 0.0;
+	float lm, l0, lp, d;
+	int i;
+
+	if (afc->method == AFC_PEAK) {
+		lm = logf(power[(peak + len - 1) % len] + 1e-30);
+		l0 = logf(power[peak] + 1e-30);
+		lp = logf(power[(peak + 1) % len] + 1e-30);
+		d = 2.0 * l0 - lm - lp;
+		d = d > 0.0 ? 0.5 * (lp - lm) / d : 0.0;
+		d = d > 0.5 ? 0.5 : d < -0.5 ? -0.5 : d;
+		return (peak < len - len / 2 ? peak : peak - len) + d;
+	}
+
+	thr = power[peak] * powf(10.0, -afc->threshold / 10.0);
+	for (i = 0; i < n; i++) {
+		if (power[i] >= thr) {
+			integrate += power[i] * (i < len - len / 2 ? i : i - len);
+			sum += power[i];
+		}
+	}
+	return sum > 0.0 ? integrate / sum : NAN;
+}
+
 static GstFlowReturn gst_afc_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_afc *afc;
 	GstCaps *caps;
-	int i;
-	float tafc;
-	float step;
-	float max = 0.0;
-	float f;
-	float integrate, sum;
 	GstBuffer *bufout;
+	GstClockTime period;
+	float f;
+	int peak, n;
 
 	afc = GST_AFC(gst_pad_get_parent(pad));
 	if (afc->length == -1) {
@@ -72,58 +134,45 @@ static GstFlowReturn gst_afc_chain(GstPad *pad, GstBuffer *buf)
 		gst_structure_get_int(structure, "length", &afc->length);
 		gst_structure_get_int(structure, "rate", &afc->rate);
 		gst_caps_unref(caps);
+		free(afc->power);
+		afc->power = malloc(sizeof(float) * afc->length);
 	}
-
-	integrate = 0.0;
-	sum = 0.0;
-	step = (float)afc->rate / (float)afc->length;
-	max = 0.0;
-	for (i = 0; i < GST_BUFFER_SIZE(buf)/sizeof(float); i++) {
-		if (((float*)GST_BUFFER_DATA(buf))[i] > max)
-			max = ((float*)GST_BUFFER_DATA(buf))[i];
-		if (-((float*)GST_BUFFER_DATA(buf))[i] > max)
-			max = -((float*)GST_BUFFER_DATA(buf))[i];
-	}
-	for (i = 0; i < GST_BUFFER_SIZE(buf)/sizeof(float)/4; i++) {
-		f = hypot(
-		    ((float*)GST_BUFFER_DATA(buf))[i*2],
-		    ((float*)GST_BUFFER_DATA(buf))[i*2+1]);
-		if (f < 0.5 * max)
-			f = 0;
-		else
-			f = max;
-		integrate += f * (float)i;
-		sum += f;
-	}
-	if (!afc->mirror) for (; i < GST_BUFFER_SIZE(buf)/sizeof(float)/2; i++){
-		f = hypot(
-		    ((float*)GST_BUFFER_DATA(buf))[i*2],
-		    ((float*)GST_BUFFER_DATA(buf))[i*2+1]);
-		if (f < 0.1 * max)
-			f = 0;
-		integrate += f * (float)(i - afc->length);
-		sum += f;
-	}
-	f = integrate / sum * step - afc->afc;
-	i = integrate / sum + 0.5;
-	
-	if (f < 0.0)
-		f = -f;
-	{
-		float divf = afc->lastf - f;
-
-		afc->lastf = f;
-		if (divf < 0.0)
-			divf = -divf;
-		f *= f / divf;// * f / divf;
-	}
-	f /= 10000000 / afc->length;
-	if (f >= 1.0)
-		f = 0.9;
-	f *= f;
-	tafc = afc->afc * (1-f) + integrate / sum * step * f;
-	if (!isnan(tafc))
-		afc->afc = tafc;
+	n = GST_BUFFER_SIZE(buf)/sizeof(float)/2;
+	if (!afc->power || n < afc->length)
+		goto out;
+
+	peak = gst_afc_power((float *)GST_BUFFER_DATA(buf), afc->power,
+	    afc->length, afc->mirror ? afc->length / 2 : afc->length);
+	f = gst_afc_estimate(afc, afc->power, peak) *
+	    afc->rate / afc->length;
+
+	/*
+	 *	First order loop filter: 'bandwidth' sets its time constant
+	 *	independent of the frame rate. A spectrum lasts until the
+	 *	next one, without a duration that is the distance between
+	 *	the timestamps, and only without those the FFT length.
+	 */
+	period = GST_BUFFER_DURATION(buf);
+	if ((!GST_CLOCK_TIME_IS_VALID(period) || !period) &&
+	    GST_CLOCK_TIME_IS_VALID(afc->last) &&
+	    GST_BUFFER_TIMESTAMP_IS_VALID(buf) &&
+	    GST_BUFFER_TIMESTAMP(buf) > afc->last)
+		period = GST_BUFFER_TIMESTAMP(buf) - afc->last;
+	if (!GST_CLOCK_TIME_IS_VALID(period) || !period)
+		period = gst_util_uint64_scale_int(GST_SECOND, afc->length,
+		    afc->rate);
+	afc->last = GST_BUFFER_TIMESTAMP(buf);
+	if (!isnan(f))
+		afc->afc += (1.0 - exp(-2.0 * M_PI * afc->bandwidth *
+		    period / GST_SECOND)) * (f - afc->afc);
+
+	GST_OBJECT_LOCK(afc);
+	if (afc->control)
+		iqcontrol_set(afc->control, afc->afc);
+	GST_OBJECT_UNLOCK(afc);
+	/* The value as a buffer is only made for those who want it */
+	if (!gst_pad_is_linked(afc->srcpad))
+		goto out;
 
 	bufout = gst_buffer_new_and_alloc(sizeof(float));
 	GST_BUFFER_SIZE(bufout) = sizeof(float);
@@ -133,9 +182,10 @@ static GstFlowReturn gst_afc_chain(GstPad *pad, GstBuffer *buf)
 	caps = gst_pad_get_caps(afc->srcpad);
 	gst_buffer_set_caps(bufout, caps);
 	gst_caps_unref(caps);
-	gst_buffer_unref(buf);
 	gst_pad_push(afc->srcpad, bufout);
 
+out:
+	gst_buffer_unref(buf);
 	gst_object_unref(afc);
 	return GST_FLOW_OK;
 }
@@ -143,6 +193,10 @@ static GstFlowReturn gst_afc_chain(GstPad *pad, GstBuffer *buf)
 static GstStateChangeReturn gst_afc_change_state(GstElement *element,
     GstStateChange transition)
 {
+	Gst_afc *afc = GST_AFC(element);
+
+	if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+		afc->last = GST_CLOCK_TIME_NONE;
 	return parent_class->change_state(element, transition);
 }
 
@@ -163,6 +217,23 @@ static void gst_afc_set_property(GObject *object, guint prop_id,
 		case ARG_MIRROR:
 			afc->mirror = g_value_get_int(value);
 			break;
+		case ARG_METHOD:
+			afc->method = g_value_get_int(value);
+			break;
+		case ARG_THRESHOLD:
+			afc->threshold = g_value_get_float(value);
+			break;
+		case ARG_BANDWIDTH:
+			afc->bandwidth = g_value_get_float(value);
+			break;
+		case ARG_CONTROL:
+			GST_OBJECT_LOCK(afc);
+			iqcontrol_put(afc->control);
+			g_free(afc->controlname);
+			afc->controlname = g_strdup(g_value_get_string(value));
+			afc->control = iqcontrol_get(afc->controlname);
+			GST_OBJECT_UNLOCK(afc);
+			break;
 		default:
 			break;
 	}
@@ -183,6 +254,18 @@ static void gst_afc_get_property(GObject *object, guint prop_id,
 		case ARG_AFC:
 			g_value_set_float(value, afc->afc);
 			break;
+		case ARG_METHOD:
+			g_value_set_int(value, afc->method);
+			break;
+		case ARG_THRESHOLD:
+			g_value_set_float(value, afc->threshold);
+			break;
+		case ARG_BANDWIDTH:
+			g_value_set_float(value, afc->bandwidth);
+			break;
+		case ARG_CONTROL:
+			g_value_set_string(value, afc->controlname);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -208,6 +291,22 @@ static void gst_afc_class_init(Gst_afc_class *klass)
 	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_AFC,
 	    g_param_spec_float("afc", "afc", "afc", -G_MAXFLOAT, G_MAXFLOAT, 0.0,
 	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_METHOD,
+	    g_param_spec_int("method", "method",
+	    "0 centroid, 1 interpolated peak", AFC_CENTROID, AFC_PEAK,
+	    AFC_CENTROID, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_THRESHOLD,
+	    g_param_spec_float("threshold", "threshold",
+	    "dB below the peak still counted in the centroid",
+	    0.0, G_MAXFLOAT, 6.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_BANDWIDTH,
+	    g_param_spec_float("bandwidth", "bandwidth",
+	    "loop bandwidth in Hz", 0.0, G_MAXFLOAT, 1.0,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_CONTROL,
+	    g_param_spec_string("control", "control",
+	    "name of the control value the afc is published to", NULL,
+	    G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_afc_change_state;
 
@@ -241,7 +340,13 @@ static void gst_afc_init(Gst_afc *afc)
 	afc->afc = 0.0;
 	afc->mirror = 1;
 	afc->offset = 0;
-	afc->lastf = 0.0;
+	afc->last = GST_CLOCK_TIME_NONE;
+	afc->method = AFC_CENTROID;
+	afc->threshold = 6.0;
+	afc->bandwidth = 1.0;
+	afc->power = NULL;
+	afc->controlname = NULL;
+	afc->control = NULL;
 }
 
 GType gst_afc_get_type(void)
@@ -0,0 +1,532 @@
+/*
+ *	Automatic gain control.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	The signal is handled in blocks of 'blocksize' samples. Each block
+ *	gets a peak envelope, and the blocks are delayed by 'lookahead' ms.
+ *	The gain for the block going out is taken from the highest peak of
+ *	all blocks in the delay, so it is already down when a strong signal
+ *	arrives. The gain moves towards 'level' over the peak with the
+ *	attack time when it goes down and the decay time when it goes up,
+ *	once per block and in dB. Within a block it ramps linearly from
+ *	the previous gain, that is a multiply per sample and no divisions.
+ *	Complex samples get the same gain for both components.
+ */
+
+#include <math.h>
+#include "gstiq.h"
+#include <string.h>
+#include <stdlib.h>
+
+static GstElementDetails iqagc_details = GST_ELEMENT_DETAILS(
+	"Automatic gain control",
+	"Filter/Effect/Audio",
+	"Keeps the level of a signal constant",
+	"agent (agent@local)"
+);
+
+enum {
+	ARG_0,
+	ARG_LEVEL,
+	ARG_MAXGAIN,
+	ARG_ATTACK,
+	ARG_DECAY,
+	ARG_LOOKAHEAD,
+	ARG_BLOCKSIZE,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-complex-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"width = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-complex-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"width = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+static GstElementClass *parent_class = NULL;
+
+static float gst_iqagc_peak(const float *in, int n, int complex)
+{
+	float p = 0.0, v;
+	int i;
+
+	if (complex) {
+		for (i = 0; i < n; i++) {
+			v = in[i*2] * in[i*2] + in[i*2+1] * in[i*2+1];
+			p = v > p ? v : p;
+		}
+		return sqrtf(p);
+	}
+	for (i = 0; i < n; i++) {
+		v = fabsf(in[i]);
+		p = v > p ? v : p;
+	}
+	return p;
+}
+
+/* Gain ramping from 'g' in steps of 'dg', loops the compiler vectorizes */
+static void gst_iqagc_apply(const float *in, float *out, int n, int complex,
+    float g, float dg)
+{
+	float gi;
+	int i;
+
+	if (complex) {
+		for (i = 0; i < n; i++) {
+			gi = g + dg * i;
+			out[i*2] = in[i*2] * gi;
+			out[i*2+1] = in[i*2+1] * gi;
+		}
+		return;
+	}
+	for (i = 0; i < n; i++)
+		out[i] = in[i] * (g + dg * i);
+}
+
+/* A full block went in: the oldest one comes out of the delay */
+static void gst_iqagc_block(Gst_iqagc *agc, float *out)
+{
+	int ch = agc->complex ? 2 : 1;
+	int b, oldest;
+	float peak, target, alpha, limit, start;
+
+	agc->peaks[agc->block] = gst_iqagc_peak(
+	    agc->delay + agc->block * agc->size * ch,
+	    agc->size, agc->complex);
+	if (++agc->block == agc->blocks)
+		agc->block = 0;
+	oldest = agc->block;
+
+	for (b = 0, peak = 0.0; b < agc->blocks; b++)
+		peak = agc->peaks[b] > peak ? agc->peaks[b] : peak;
+	target = peak * agc->maxgainf > agc->level ?
+	    agc->level / peak : agc->maxgainf;
+	/* Smoothed in dB, a large step takes as long as a small one */
+	alpha = target < agc->gain ? agc->attackalpha : agc->decayalpha;
+	target = agc->gain * powf(target / agc->gain, alpha);
+
+	/* Never above the level, even when the attack is too slow */
+	limit = agc->peaks[oldest] * target > agc->level ?
+	    agc->level / agc->peaks[oldest] : target;
+	target = target < limit ? target : limit;
+	start = agc->gain < limit ? agc->gain : limit;
+
+	gst_iqagc_apply(agc->delay + oldest * agc->size * ch, out,
+	    agc->size, agc->complex, start,
+	    (target - start) / agc->size);
+	agc->gain = target;
+}
+
+static void gst_iqagc_times(Gst_iqagc *agc)
+{
+	if (!agc->rate)
+		return;
+	agc->attackalpha = agc->attack > 0.0 ? 1.0 - exp(-agc->size /
+	    (agc->attack * 0.001 * agc->rate)) : 1.0;
+	agc->decayalpha = agc->decay > 0.0 ? 1.0 - exp(-agc->size /
+	    (agc->decay * 0.001 * agc->rate)) : 1.0;
+}
+
+/* The delay line holds the look-ahead plus the block being filled */
+static int gst_iqagc_setup(Gst_iqagc *agc)
+{
+	int ch = agc->complex ? 2 : 1;
+	float lookahead;
+
+	GST_OBJECT_LOCK(agc);
+	agc->size = agc->blocksize;
+	lookahead = agc->lookahead;
+	agc->reconfigure = 0;
+	GST_OBJECT_UNLOCK(agc);
+
+	if (!agc->rate)
+		return 0;
+	agc->blocks = ceil(lookahead * 0.001 * agc->rate /
+	    agc->size) + 1;
+	free(agc->delay);
+	free(agc->peaks);
+	agc->delay = calloc(agc->blocks * agc->size * ch, sizeof(float));
+	agc->peaks = calloc(agc->blocks, sizeof(float));
+	agc->block = 0;
+	agc->fill = 0;
+	gst_iqagc_times(agc);
+	if (!agc->delay || !agc->peaks) {
+		free(agc->delay);
+		free(agc->peaks);
+		agc->delay = NULL;
+		agc->peaks = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ *	Send out 'samples' samples. The output lags the input by the delay
+ *	and the partial block, 'latency' samples before they went in.
+ */
+static void gst_iqagc_push(Gst_iqagc *agc, GstBuffer *outbuf,
+    GstClockTime timestamp, int latency, int samples)
+{
+	GstCaps *caps;
+	GstClockTime lag;
+
+	lag = gst_util_uint64_scale_int(GST_SECOND, latency, agc->rate);
+	if (GST_CLOCK_TIME_IS_VALID(timestamp))
+		timestamp = timestamp > lag ? timestamp - lag : 0;
+	GST_BUFFER_TIMESTAMP(outbuf) = timestamp;
+	GST_BUFFER_OFFSET(outbuf) = agc->offset;
+	agc->offset += samples;
+
+	caps = gst_pad_get_caps(agc->srcpad);
+	gst_buffer_set_caps(outbuf, caps);
+	gst_caps_unref(caps);
+	gst_pad_push(agc->srcpad, outbuf);
+}
+
+/*
+ *	Out with everything in the delay before it changes size, oldest
+ *	block first and the partial block last. There is no look-ahead
+ *	left for these, the gain only goes down where a block needs it.
+ */
+static void gst_iqagc_drain(Gst_iqagc *agc, GstClockTime timestamp)
+{
+	GstBuffer *outbuf;
+	int ch = agc->complex ? 2 : 1;
+	int samples = (agc->blocks - 1) * agc->size + agc->fill;
+	int i, b, n;
+	float *out, *in, peak, g;
+
+	if (!samples)
+		return;
+	outbuf = gst_buffer_new_and_alloc(sizeof(float) * ch * samples);
+	out = (float *)GST_BUFFER_DATA(outbuf);
+	for (i = 1; i <= agc->blocks; i++) {
+		b = (agc->block + i) % agc->blocks;
+		n = b == agc->block ? agc->fill : agc->size;
+		in = agc->delay + b * agc->size * ch;
+		peak = gst_iqagc_peak(in, n, agc->complex);
+		g = peak * agc->gain > agc->level ?
+		    agc->level / peak : agc->gain;
+		gst_iqagc_apply(in, out, n, agc->complex, g, 0.0);
+		out += n * ch;
+	}
+	gst_iqagc_push(agc, outbuf, timestamp, samples, samples);
+}
+
+static GstFlowReturn gst_iqagc_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_iqagc *agc;
+	GstBuffer *outbuf = NULL;
+	GstClockTime timestamp;
+	float *in, *out = NULL;
+	int ch, n, len, blocks, latency, reconfigure;
+
+	agc = GST_IQAGC(gst_pad_get_parent(pad));
+	if (!agc->delay) {
+		gst_buffer_unref(buf);
+		gst_object_unref(agc);
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	/*
+	 *	A new look-ahead or block size is taken here, the old delay
+	 *	is emptied first. The new one starts empty, as at the start
+	 *	of the stream.
+	 */
+	timestamp = GST_BUFFER_TIMESTAMP(buf);
+	GST_OBJECT_LOCK(agc);
+	reconfigure = agc->reconfigure;
+	GST_OBJECT_UNLOCK(agc);
+	if (reconfigure) {
+		gst_iqagc_drain(agc, timestamp);
+		if (gst_iqagc_setup(agc)) {
+			gst_buffer_unref(buf);
+			gst_object_unref(agc);
+			return GST_FLOW_ERROR;
+		}
+	}
+
+	ch = agc->complex ? 2 : 1;
+	n = GST_BUFFER_SIZE(buf) / (sizeof(float) * ch);
+	in = (float *)GST_BUFFER_DATA(buf);
+	blocks = (agc->fill + n) / agc->size;
+	latency = (agc->blocks - 1) * agc->size + agc->fill;
+
+	/* Not even a block yet: nothing to push */
+	if (blocks) {
+		outbuf = gst_buffer_new_and_alloc(
+		    sizeof(float) * ch * blocks * agc->size);
+		out = (float *)GST_BUFFER_DATA(outbuf);
+	}
+
+	while (n) {
+		len = agc->size - agc->fill;
+		len = len < n ? len : n;
+		memcpy(agc->delay + (agc->block * agc->size +
+		    agc->fill) * ch, in, sizeof(float) * ch * len);
+		agc->fill += len;
+		in += len * ch;
+		n -= len;
+		if (agc->fill < agc->size)
+			break;
+		agc->fill = 0;
+		gst_iqagc_block(agc, out);
+		out += agc->size * ch;
+	}
+	gst_buffer_unref(buf);
+
+	if (outbuf)
+		gst_iqagc_push(agc, outbuf, timestamp, latency,
+		    blocks * agc->size);
+
+	gst_object_unref(agc);
+	return GST_FLOW_OK;
+}
+
+static void gst_iqagc_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_iqagc *agc;
+
+	g_return_if_fail(GST_IS_IQAGC(object));
+	agc = GST_IQAGC(object);
+
+	switch(prop_id) {
+		case ARG_LEVEL:
+			agc->level = g_value_get_float(value);
+			break;
+		case ARG_MAXGAIN:
+			agc->maxgain = g_value_get_float(value);
+			agc->maxgainf = pow(10.0, agc->maxgain / 20.0);
+			break;
+		case ARG_ATTACK:
+			agc->attack = g_value_get_float(value);
+			gst_iqagc_times(agc);
+			break;
+		case ARG_DECAY:
+			agc->decay = g_value_get_float(value);
+			gst_iqagc_times(agc);
+			break;
+		/* The chain changes the delay between two buffers */
+		case ARG_LOOKAHEAD:
+			GST_OBJECT_LOCK(agc);
+			agc->lookahead = g_value_get_float(value);
+			agc->reconfigure = 1;
+			GST_OBJECT_UNLOCK(agc);
+			break;
+		case ARG_BLOCKSIZE:
+			GST_OBJECT_LOCK(agc);
+			agc->blocksize = g_value_get_int(value);
+			agc->reconfigure = 1;
+			GST_OBJECT_UNLOCK(agc);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_iqagc_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_iqagc *agc;
+
+	g_return_if_fail(GST_IS_IQAGC(object));
+	agc = GST_IQAGC(object);
+
+	switch(prop_id) {
+		case ARG_LEVEL:
+			g_value_set_float(value, agc->level);
+			break;
+		case ARG_MAXGAIN:
+			g_value_set_float(value, agc->maxgain);
+			break;
+		case ARG_ATTACK:
+			g_value_set_float(value, agc->attack);
+			break;
+		case ARG_DECAY:
+			g_value_set_float(value, agc->decay);
+			break;
+		case ARG_LOOKAHEAD:
+			g_value_set_float(value, agc->lookahead);
+			break;
+		case ARG_BLOCKSIZE:
+			g_value_set_int(value, agc->blocksize);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static GstStateChangeReturn gst_iqagc_change_state(GstElement *element,
+    GstStateChange transition)
+{
+	return parent_class->change_state(element, transition);
+}
+
+static gboolean gst_iqagc_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_iqagc *agc;
+	GstStructure *structure;
+	gboolean ret = FALSE;
+
+	agc = GST_IQAGC(gst_pad_get_parent(pad));
+
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_get_int(structure, "rate", &agc->rate);
+	agc->complex = gst_structure_has_name(structure,
+	    "audio/x-complex-float");
+
+	if (!gst_iqagc_setup(agc)) {
+		gst_pad_use_fixed_caps(agc->srcpad);
+		ret = gst_pad_set_caps(agc->srcpad, caps);
+	}
+
+	gst_object_unref(agc);
+	return ret;
+}
+
+static void gst_iqagc_class_init(Gst_iqagc_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gobject_class->set_property = gst_iqagc_set_property;
+	gobject_class->get_property = gst_iqagc_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_LEVEL,
+	    g_param_spec_float("level", "level",
+	    "output peak level",
+	    1e-6, G_MAXFLOAT, 0.5, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_MAXGAIN,
+	    g_param_spec_float("max-gain", "max-gain",
+	    "highest gain in dB",
+	    -G_MAXFLOAT, G_MAXFLOAT, 60.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_ATTACK,
+	    g_param_spec_float("attack", "attack",
+	    "time constant of a gain decrease in ms",
+	    0.0, G_MAXFLOAT, 2.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_DECAY,
+	    g_param_spec_float("decay", "decay",
+	    "time constant of a gain increase in ms",
+	    0.0, G_MAXFLOAT, 200.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_LOOKAHEAD,
+	    g_param_spec_float("lookahead", "lookahead",
+	    "delay in ms, the gain drops before a peak arrives",
+	    0.0, 10000.0, 5.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_BLOCKSIZE,
+	    g_param_spec_int("blocksize", "blocksize",
+	    "samples per gain step",
+	    1, 65536, 64, G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_iqagc_change_state;
+
+	gst_element_class_set_details(gstelement_class, &iqagc_details);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&src_template));
+}
+
+static void gst_iqagc_init(Gst_iqagc *agc)
+{
+	agc->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&sink_template), "sink");
+
+	gst_pad_set_chain_function(agc->sinkpad, gst_iqagc_chain);
+	gst_pad_set_setcaps_function(agc->sinkpad, gst_iqagc_setcaps);
+	gst_element_add_pad(GST_ELEMENT(agc), agc->sinkpad);
+
+	agc->srcpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&src_template), "src");
+	gst_element_add_pad(GST_ELEMENT(agc), agc->srcpad);
+
+	agc->rate = 0;
+	agc->complex = FALSE;
+	agc->level = 0.5;
+	agc->maxgain = 60.0;
+	agc->maxgainf = 1000.0;
+	agc->attack = 2.0;
+	agc->decay = 200.0;
+	agc->lookahead = 5.0;
+	agc->blocksize = 64;
+	agc->size = 64;
+	agc->reconfigure = 0;
+	agc->gain = 1.0;
+	agc->delay = NULL;
+	agc->peaks = NULL;
+	agc->blocks = 0;
+	agc->block = 0;
+	agc->fill = 0;
+	agc->offset = 0;
+}
+
+GType gst_iqagc_get_type(void)
+{
+	static GType iqagc_type = 0;
+
+	if (!iqagc_type) {
+		static const GTypeInfo iqagc_info = {
+			sizeof(Gst_iqagc_class),
+			NULL,
+			NULL,
+			(GClassInitFunc)gst_iqagc_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_iqagc),
+			0,
+			(GInstanceInitFunc)gst_iqagc_init,
+		};
+		iqagc_type = g_type_register_static(GST_TYPE_ELEMENT,
+		    "GstIQAGC", &iqagc_info, 0);
+	}
+	return iqagc_type;
+}
@@ -1,5 +1,5 @@
 /*
- *	Quadrature frequency demodulator.
+ *	Quadrature amplitude demodulator.
  *
  *	Copyright Jeroen Vreeken (pe1rxq@amsat.org), 2005
  *
@@ -9,6 +9,16 @@
  *	the License, or (at your option) any later version.
  */
 
+/*
+ *	Polar input is demodulated from its magnitude. Complex input needs
+ *	no iqpolar stage: 'envelope' mode takes the magnitude itself,
+ *	'synchronous' mode locks a PLL to the carrier and takes the
+ *	in-phase component. That does not distort when selective fading
+ *	takes away the carrier or one sideband for a moment.
+ *	The PLL oscillator is a unit phasor that is rotated every sample,
+ *	no trigonometry per sample.
+ */
+
 #include "gstiq.h"
 #include <string.h>
 #include <math.h>
@@ -22,7 +32,14 @@ static GstElementDetails iqamdem_details = GST_ELEMENT_DETAILS(
 
 enum {
 	ARG_0,
-	ARG_DEPTH
+	ARG_DEPTH,
+	ARG_MODE,
+	ARG_BANDWIDTH,
+};
+
+enum {
+	IQAMDEM_ENVELOPE,
+	IQAMDEM_SYNCHRONOUS,
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
@@ -36,6 +53,14 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 		"width = (int) 64, "
 		"rate = (int) [ 1, MAX ], "
 		"buffer-frames = (int) [ 0, MAX ], "
+		"channels = (int) 1; "
+
+		"audio/x-complex-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"width = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"buffer-frames = (int) [ 0, MAX ], "
 		"channels = (int) 1"
 	)
 );
@@ -57,24 +82,78 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 
 static GstElementClass *parent_class = NULL;
 
+/* Magnitude of complex samples, a loop the compiler can vectorize */
+static void gst_iqamdem_magnitude(const gfloat *iqbuf, gfloat *out, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		out[i] = sqrtf(iqbuf[i*2] * iqbuf[i*2] +
+		    iqbuf[i*2+1] * iqbuf[i*2+1]);
+}
+
+/* In-phase component of complex samples against the carrier PLL */
+static void gst_iqamdem_synchronous(Gst_iqamdem *amdem,
+    const gfloat *iqbuf, gfloat *out, int n)
+{
+	float pr = amdem->pr, pi = amdem->pi, freq = amdem->freq;
+	float i_, q, e, d, cr, ci, t, g;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		/* Mix down with the conjugate of the oscillator */
+		i_ = iqbuf[i*2] * pr + iqbuf[i*2+1] * pi;
+		q = iqbuf[i*2+1] * pr - iqbuf[i*2] * pi;
+		out[i] = i_;
+
+		/* sin of the phase error, independent of the level */
+		e = q / (sqrtf(i_ * i_ + q * q) + 1e-20);
+		freq += amdem->ki * e;
+		d = freq + amdem->kp * e;
+
+		/* Rotate by d radians, small enough for cos = 1 - d^2/2 */
+		cr = 1.0 - d * d * 0.5;
+		ci = d;
+		t = pr * cr - pi * ci;
+		pi = pr * ci + pi * cr;
+		pr = t;
+		/* Keep it a unit phasor */
+		g = 1.5 - 0.5 * (pr * pr + pi * pi);
+		pr *= g;
+		pi *= g;
+	}
+	amdem->pr = pr;
+	amdem->pi = pi;
+	amdem->freq = freq;
+}
+
 static GstFlowReturn gst_iqamdem_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_iqamdem *amdem;
 	GstBuffer *outbuf;
 	GstCaps *caps;
 	gfloat *iqbuf, *bufout, abs;
-	int i;
+	int i, n;
 
 	amdem = GST_IQAMDEM(gst_pad_get_parent(pad));
 
-	outbuf = gst_buffer_new_and_alloc(GST_BUFFER_SIZE(buf)/2);
+	n = GST_BUFFER_SIZE(buf) / (sizeof(gfloat) * 2);
+	outbuf = gst_buffer_new_and_alloc(n * sizeof(gfloat));
 	GST_BUFFER_OFFSET(outbuf) = amdem->offset;
 	GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
 
 	iqbuf = (gfloat *)GST_BUFFER_DATA(buf);
 	bufout = (gfloat *)GST_BUFFER_DATA(outbuf);
-	for (i = 0; i < GST_BUFFER_SIZE(outbuf)/sizeof(gfloat); i++) {
-		abs = iqbuf[i*2];
+	if (!amdem->complex) {
+		for (i = 0; i < n; i++)
+			bufout[i] = iqbuf[i*2];
+	} else if (amdem->mode == IQAMDEM_SYNCHRONOUS) {
+		gst_iqamdem_synchronous(amdem, iqbuf, bufout, n);
+	} else {
+		gst_iqamdem_magnitude(iqbuf, bufout, n);
+	}
+	for (i = 0; i < n; i++) {
+		abs = bufout[i];
 		bufout[i] = (abs - amdem->avrg) / amdem->depth;
 		amdem->avrg += (abs - amdem->avrg) / amdem->avrglen;
 	}
@@ -90,6 +169,19 @@ static GstFlowReturn gst_iqamdem_chain(GstPad *pad, GstBuffer *buf)
 	return GST_FLOW_OK;
 }
 
+/* Second order loop with damping 0.707, gains per sample */
+static void gst_iqamdem_loop(Gst_iqamdem *amdem)
+{
+	double zeta = 0.707, wn;
+
+	if (!amdem->rate)
+		return;
+	wn = 2.0 * 2.0 * M_PI * amdem->bandwidth /
+	    (zeta + 1.0 / (4.0 * zeta));
+	amdem->kp = 2.0 * zeta * wn / amdem->rate;
+	amdem->ki = wn * wn / ((double)amdem->rate * amdem->rate);
+}
+
 static void gst_iqamdem_set_property(GObject *object, guint prop_id,
     const GValue *value, GParamSpec *pspec)
 {
@@ -102,6 +194,13 @@ static void gst_iqamdem_set_property(GObject *object, guint prop_id,
 		case ARG_DEPTH:
 			amdem->depth = g_value_get_float(value);
 			break;
+		case ARG_MODE:
+			amdem->mode = g_value_get_int(value);
+			break;
+		case ARG_BANDWIDTH:
+			amdem->bandwidth = g_value_get_float(value);
+			gst_iqamdem_loop(amdem);
+			break;
 		default:
 			break;
 	}
@@ -119,6 +218,12 @@ static void gst_iqamdem_get_property(GObject *object, guint prop_id,
 		case ARG_DEPTH:
 			g_value_set_float(value, amdem->depth);
 			break;
+		case ARG_MODE:
+			g_value_set_int(value, amdem->mode);
+			break;
+		case ARG_BANDWIDTH:
+			g_value_set_float(value, amdem->bandwidth);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -137,26 +242,54 @@ static gboolean gst_iqamdem_setcaps(GstPad *pad, GstCaps *caps)
 	Gst_iqamdem *amdem;
 	GstCaps *newcaps;
 	GstPad *other;
-	gint bufferframes;
+	gint bufferframes = 0;
+	gboolean ret;
 
 	amdem = GST_IQAMDEM(gst_pad_get_parent(pad));
+
+	/*
+	 *	Setting the src caps from the sink setcaps ends up here, the
+	 *	sink pad has no caps of its own yet but is being set up.
+	 */
+	if (pad == amdem->srcpad && GST_PAD_IS_IN_SETCAPS(amdem->sinkpad)) {
+		gst_object_unref(amdem);
+		return TRUE;
+	}
+
 	structure = gst_caps_get_structure(caps, 0);
 	gst_structure_get_int(structure, "rate", &amdem->rate);
 	gst_structure_get_int(structure, "buffer-frames", &bufferframes);
+	/* Only the sink caps tell what the input is */
+	if (pad == amdem->sinkpad)
+		amdem->complex = gst_structure_has_name(structure,
+		    "audio/x-complex-float");
 
 	amdem->avrglen = amdem->rate / 10;
-
+	gst_iqamdem_loop(amdem);
+
+	/*
+	 *	Caps from downstream keep the input format upstream already
+	 *	gave. Without one the input is pinned to polar, as before
+	 *	complex input existed, and the sink setcaps that follows
+	 *	clears 'complex'. A complex source has to be negotiated from
+	 *	upstream.
+	 */
 	other = pad == amdem->srcpad ? amdem->sinkpad : amdem->srcpad;
-	newcaps = gst_pad_get_caps(other);
-	newcaps = gst_caps_make_writable(newcaps);
+	if (pad == amdem->srcpad && GST_PAD_CAPS(amdem->sinkpad))
+		newcaps = gst_caps_copy(GST_PAD_CAPS(amdem->sinkpad));
+	else
+		newcaps = gst_caps_copy_nth(
+		    gst_pad_get_pad_template_caps(other), 0);
 	structure = gst_caps_get_structure(newcaps, 0);
 	gst_structure_set(structure, "rate", G_TYPE_INT, amdem->rate, NULL);
 	gst_structure_set(structure, "buffer-frames", G_TYPE_INT, bufferframes,
 	    NULL);
 
 	gst_pad_use_fixed_caps(other);
+	ret = gst_pad_set_caps(other, newcaps);
+	gst_caps_unref(newcaps);
 	gst_object_unref(amdem);
-	return gst_pad_set_caps(other, newcaps);
+	return ret;
 }
 
 static void gst_iqamdem_class_init(Gst_iqamdem_class *klass)
@@ -175,6 +308,15 @@ static void gst_iqamdem_class_init(Gst_iqamdem_class *klass)
 	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_DEPTH,
 	    g_param_spec_float("depth", "depth", "depth",
 	    0.01, G_MAXFLOAT, 1.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_MODE,
+	    g_param_spec_int("mode", "mode",
+	    "complex input: 0 envelope, 1 synchronous",
+	    IQAMDEM_ENVELOPE, IQAMDEM_SYNCHRONOUS, IQAMDEM_ENVELOPE,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_BANDWIDTH,
+	    g_param_spec_float("bandwidth", "bandwidth",
+	    "carrier PLL bandwidth in Hz",
+	    0.1, G_MAXFLOAT, 20.0, G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_iqamdem_change_state;
 
@@ -203,6 +345,13 @@ static void gst_iqamdem_init(Gst_iqamdem *amdem)
 
 	amdem->depth = 1.0;
 	amdem->avrg = 0.0;
+	amdem->rate = 0;
+	amdem->complex = FALSE;
+	amdem->mode = IQAMDEM_ENVELOPE;
+	amdem->bandwidth = 20.0;
+	amdem->pr = 1.0;
+	amdem->pi = 0.0;
+	amdem->freq = 0.0;
 	amdem->offset = 0;
 }
 
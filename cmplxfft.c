@@ -13,6 +13,7 @@
 #include <fftw3.h>
 #include "gstiq.h"
 #include <string.h>
+#include <stdlib.h>
 
 static GstElementDetails cmplxfft_details = GST_ELEMENT_DETAILS(
 	"Complex FFT plugin",
@@ -30,6 +31,13 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 		"endianness = (int) BYTE_ORDER, "
 		"depth = (int) 64, "
 		"channels = (int) 1, "
+		"rate = (int) [ 1, MAX ]; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"channels = (int) 1, "
 		"rate = (int) [ 1, MAX ] "
 	)
 );
@@ -48,47 +56,276 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 	)
 );
 
+/* Transforms of at least this length are planned with multiple threads */
+#define CMPLXFFT_THREADS_MIN	16384
+
+enum {
+	ARG_0,
+	ARG_THREADS,
+	ARG_BATCH,
+	ARG_FPS,
+	ARG_OVERLAP,
+	ARG_WINDOW,
+};
+
 static GstElementClass *parent_class = NULL;
 
+/*
+ *	Normalize 'frames' transformed frames from the work buffer and push
+ *	them downstream, one buffer per frame.
+ *	A real input transform only yields the lower half of the spectrum,
+ *	the upper half is mirrored from it so the output layout is the same
+ *	as for complex input.
+ *	'start' is the position of the first frame relative to the input
+ *	buffer, negative when it began in an earlier one. Each frame gets
+ *	the time of its first sample, and lasts until the next frame starts,
+ *	length/overlap samples later.
+ */
+static void gst_cmplxfft_push(Gst_cmplxfft *cmplxfft, GstBuffer *buf,
+    int frames, int start)
+{
+	GstBuffer *outbuf, *framebuf;
+	GstCaps *caps;
+	float *in, *out;
+	float scale;
+	gdouble elapsed;
+	GstClockTime timestamp, duration, lag;
+	gint64 pos;
+	int framesize;
+	int n = cmplxfft->length;
+	int f, k;
+
+	framesize = n * sizeof(fftwf_complex);
+	outbuf = gst_buffer_new_and_alloc(framesize * frames);
+	in = (float *)cmplxfft->buffer;
+	out = (float *)GST_BUFFER_DATA(outbuf);
+	scale = 1.0 / n;
+	if (!cmplxfft->real) {
+		for (k = 0; k < n * 2 * frames; k++)
+			out[k] = in[k] * scale;
+	} else for (f = 0; f < frames; f++, in += n * 2, out += n * 2) {
+		for (k = 0; k <= n / 2; k++) {
+			out[k*2] = in[k*2] * scale;
+			out[k*2+1] = in[k*2+1] * scale;
+		}
+		for (; k < n; k++) {
+			out[k*2] = in[(n-k)*2] * scale;
+			out[k*2+1] = -in[(n-k)*2+1] * scale;
+		}
+	}
+
+	duration = GST_CLOCK_TIME_NONE;
+	if (cmplxfft->rate)
+		duration = gst_util_uint64_scale_int(GST_SECOND,
+		    cmplxfft->hop, cmplxfft->rate);
+
+	caps = gst_pad_get_caps(cmplxfft->srcpad);
+	for (f = 0; f < frames; f++) {
+		if (frames == 1)
+			framebuf = outbuf;
+		else
+			framebuf = gst_buffer_create_sub(outbuf,
+			    f * framesize, framesize);
+		gst_buffer_set_caps(framebuf, caps);
+		GST_BUFFER_OFFSET(framebuf) = cmplxfft->offset;
+		cmplxfft->offset++;
+		timestamp = GST_BUFFER_TIMESTAMP(buf);
+		if (cmplxfft->rate && GST_CLOCK_TIME_IS_VALID(timestamp)) {
+			pos = start + (gint64)f * n;
+			lag = gst_util_uint64_scale_int(pos < 0 ? -pos : pos,
+			    GST_SECOND, cmplxfft->rate);
+			if (pos >= 0)
+				timestamp += lag;
+			else
+				timestamp = timestamp > lag ?
+				    timestamp - lag : 0;
+		}
+		GST_BUFFER_TIMESTAMP(framebuf) = timestamp;
+		GST_BUFFER_DURATION(framebuf) = duration;
+		gst_pad_push(cmplxfft->srcpad, framebuf);
+	}
+	if (frames != 1)
+		gst_buffer_unref(outbuf);
+	gst_caps_unref(caps);
+
+	cmplxfft->frames += frames;
+	elapsed = g_timer_elapsed(cmplxfft->timer, NULL);
+	if (elapsed >= 1.0) {
+		cmplxfft->fps = cmplxfft->frames / elapsed;
+		cmplxfft->frames = 0;
+		g_timer_start(cmplxfft->timer);
+	}
+}
+
+/* Multiply 'frames' frames in the input buffer with the analysis window */
+static void gst_cmplxfft_window(Gst_cmplxfft *cmplxfft, int frames)
+{
+	float *win = cmplxfft->win;
+	float *in;
+	int n = cmplxfft->length;
+	int f, k;
+
+	if (!win)
+		return;
+	if (cmplxfft->real) {
+		in = cmplxfft->rbuffer;
+		for (f = 0; f < frames; f++, in += n)
+			for (k = 0; k < n; k++)
+				in[k] *= win[k];
+	} else {
+		in = (float *)cmplxfft->buffer;
+		for (f = 0; f < frames; f++, in += n * 2)
+			for (k = 0; k < n; k++) {
+				in[k*2] *= win[k];
+				in[k*2+1] *= win[k];
+			}
+	}
+}
+
+static int gst_cmplxfft_setup(Gst_cmplxfft *cmplxfft)
+{
+	int n = cmplxfft->length;
+	int batch = cmplxfft->batch;
+	int kind = cmplxfft->real ? FFTPLAN_R2C : FFTPLAN_FORWARD;
+	void *in;
+
+	GST_OBJECT_LOCK(cmplxfft);
+	cmplxfft->reconfigure = 0;
+	GST_OBJECT_UNLOCK(cmplxfft);
+
+	if (cmplxfft->buffer) {
+		fftwf_free(cmplxfft->buffer);
+		if (cmplxfft->rbuffer)
+			fftwf_free(cmplxfft->rbuffer);
+		iqfftplan_put(cmplxfft->plan);
+		iqfftplan_put(cmplxfft->batchplan);
+	}
+	if (cmplxfft->win)
+		free(cmplxfft->win);
+	if (cmplxfft->tail)
+		free(cmplxfft->tail);
+	cmplxfft->buffer = NULL;
+	cmplxfft->rbuffer = NULL;
+	cmplxfft->batchplan = NULL;
+	cmplxfft->win = NULL;
+	cmplxfft->tail = NULL;
+	if (cmplxfft->length < 2)
+		return -1;
+	if (cmplxfft->overlap > n)
+		cmplxfft->overlap = n;
+	cmplxfft->hop = n / cmplxfft->overlap;
+	if (cmplxfft->window != WINDOW_RECTANGULAR)
+		cmplxfft->win = iqwindow_analysis(cmplxfft->window, n);
+	if (cmplxfft->overlap > 1)
+		cmplxfft->tail = malloc(sizeof(fftwf_complex) *
+		    (n - cmplxfft->hop));
+	cmplxfft->buffer = fftwf_malloc(sizeof(fftwf_complex) * n * batch);
+	if (!cmplxfft->buffer)
+		return -1;
+	in = cmplxfft->buffer;
+	if (cmplxfft->real) {
+		cmplxfft->rbuffer = fftwf_malloc(sizeof(float) * n * batch);
+		if (!cmplxfft->rbuffer) {
+			fftwf_free(cmplxfft->buffer);
+			cmplxfft->buffer = NULL;
+			return -1;
+		}
+		in = cmplxfft->rbuffer;
+	}
+	cmplxfft->plan = iqfftplan_get(kind, n, 1,
+	    n >= CMPLXFFT_THREADS_MIN ? cmplxfft->threads : 1,
+	    in, cmplxfft->buffer);
+	if (!cmplxfft->plan) {
+		fftwf_free(cmplxfft->buffer);
+		if (cmplxfft->rbuffer)
+			fftwf_free(cmplxfft->rbuffer);
+		cmplxfft->buffer = NULL;
+		cmplxfft->rbuffer = NULL;
+		return -1;
+	}
+	if (batch > 1)
+		cmplxfft->batchplan = iqfftplan_get(kind, n, batch,
+		    n * batch >= CMPLXFFT_THREADS_MIN ? cmplxfft->threads : 1,
+		    in, cmplxfft->buffer);
+	cmplxfft->fill = 0;
+	return 0;
+}
+
+/* Run a shared plan on this instance's buffers */
+static void gst_cmplxfft_execute(Gst_cmplxfft *cmplxfft, fftwf_plan plan)
+{
+	if (cmplxfft->real)
+		fftwf_execute_dft_r2c(plan, cmplxfft->rbuffer,
+		    cmplxfft->buffer);
+	else
+		fftwf_execute_dft(plan, cmplxfft->buffer, cmplxfft->buffer);
+}
+
 static GstFlowReturn gst_cmplxfft_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_cmplxfft *cmplxfft;
-	GstBuffer *outbuf;
-	GstCaps *caps;
-	int i, j;
+	int i, j, samples, batchlen, keep;
+	guint8 *in;
+	int ss;
+	int reconfigure;
 
 	cmplxfft = GST_CMPLXFFT(gst_pad_get_parent(pad));
+	/* New properties: rebuild the buffers here, not under our feet */
+	GST_OBJECT_LOCK(cmplxfft);
+	reconfigure = cmplxfft->reconfigure;
+	GST_OBJECT_UNLOCK(cmplxfft);
+	if (reconfigure)
+		gst_cmplxfft_setup(cmplxfft);
 	if (cmplxfft->buffer) {
+		if (cmplxfft->real) {
+			ss = sizeof(float);
+			in = (guint8 *)cmplxfft->rbuffer;
+		} else {
+			ss = sizeof(fftwf_complex);
+			in = (guint8 *)cmplxfft->buffer;
+		}
+		samples = GST_BUFFER_SIZE(buf) / ss;
+		batchlen = cmplxfft->length * cmplxfft->batch;
+		keep = cmplxfft->tail ?
+		    cmplxfft->length - cmplxfft->hop : 0;
 		j = 0;
-		while (j < GST_BUFFER_SIZE(buf)/sizeof(fftwf_complex)) {
-			i = GST_BUFFER_SIZE(buf)/sizeof(fftwf_complex) - j;
+		while (j < samples) {
+			/* Whole frames left in this buffer: do them at once */
+			if (cmplxfft->batchplan && !cmplxfft->tail &&
+			    cmplxfft->fill == 0 && samples - j >= batchlen) {
+				memcpy(in, GST_BUFFER_DATA(buf) + j * ss,
+				    batchlen * ss);
+				gst_cmplxfft_window(cmplxfft, cmplxfft->batch);
+				gst_cmplxfft_execute(cmplxfft,
+				    cmplxfft->batchplan);
+				gst_cmplxfft_push(cmplxfft, buf, cmplxfft->batch, j);
+				j += batchlen;
+				continue;
+			}
+			i = samples - j;
 			if (i > cmplxfft->length - cmplxfft->fill)
 				i = cmplxfft->length - cmplxfft->fill;
-			memcpy(cmplxfft->buffer + cmplxfft->fill,
-			    GST_BUFFER_DATA(buf) + j * sizeof(fftwf_complex),
-			    i * sizeof(fftwf_complex));
+			memcpy(in + cmplxfft->fill * ss,
+			    GST_BUFFER_DATA(buf) + j * ss, i * ss);
 			j += i;
 			cmplxfft->fill += i;
 			if (cmplxfft->fill >= cmplxfft->length) {
-				int k;
-				cmplxfft->fill = 0;
-				outbuf = gst_buffer_new_and_alloc(
-				    cmplxfft->length * sizeof(fftwf_complex));
-				fftwf_execute(cmplxfft->plan);
-				memcpy(GST_BUFFER_DATA(outbuf), cmplxfft->buffer,
-				    sizeof(fftwf_complex) * cmplxfft->length);
-				for (k = 0; k < cmplxfft->length * 2; k++) {
-					((float *)GST_BUFFER_DATA(outbuf))[k]
-					    /= cmplxfft->length;
-				}
-				caps = gst_pad_get_caps(cmplxfft->srcpad);
-				gst_buffer_set_caps(outbuf, caps);
-				gst_caps_unref(caps);
-				GST_BUFFER_OFFSET(outbuf) = cmplxfft->offset;
-				cmplxfft->offset++;
-				GST_BUFFER_TIMESTAMP(outbuf) =
-				    GST_BUFFER_TIMESTAMP(buf);
-				gst_pad_push(cmplxfft->srcpad, outbuf);
+				/*
+				 * Overlapping frames: the last samples are
+				 * also the start of the next frame, keep them
+				 * unwindowed.
+				 */
+				if (keep)
+					memcpy(cmplxfft->tail, in +
+					    (cmplxfft->length - keep) * ss,
+					    keep * ss);
+				gst_cmplxfft_window(cmplxfft, 1);
+				gst_cmplxfft_execute(cmplxfft, cmplxfft->plan);
+				gst_cmplxfft_push(cmplxfft, buf, 1,
+				    j - cmplxfft->length);
+				if (keep)
+					memcpy(in, cmplxfft->tail, keep * ss);
+				cmplxfft->fill = keep;
 			}
 		}
 	}
@@ -97,24 +334,72 @@ static GstFlowReturn gst_cmplxfft_chain(GstPad *pad, GstBuffer *buf)
 	return GST_FLOW_OK;
 }
 
-static int gst_cmplxfft_setup(Gst_cmplxfft *cmplxfft)
+static void gst_cmplxfft_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
 {
-	int n = cmplxfft->length;
+	Gst_cmplxfft *cmplxfft;
 
-	if (cmplxfft->buffer) {
-		fftwf_free(cmplxfft->buffer);
-		fftwf_destroy_plan(cmplxfft->plan);
+	g_return_if_fail(GST_IS_CMPLXFFT(object));
+	cmplxfft = GST_CMPLXFFT(object);
+
+	switch(prop_id) {
+		case ARG_THREADS:
+			GST_OBJECT_LOCK(cmplxfft);
+			cmplxfft->threads = g_value_get_int(value);
+			cmplxfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxfft);
+			break;
+		case ARG_BATCH:
+			GST_OBJECT_LOCK(cmplxfft);
+			cmplxfft->batch = g_value_get_int(value);
+			cmplxfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxfft);
+			break;
+		case ARG_OVERLAP:
+			GST_OBJECT_LOCK(cmplxfft);
+			cmplxfft->overlap = g_value_get_int(value);
+			cmplxfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxfft);
+			break;
+		case ARG_WINDOW:
+			GST_OBJECT_LOCK(cmplxfft);
+			cmplxfft->window = g_value_get_int(value);
+			cmplxfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxfft);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_cmplxfft_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_cmplxfft *cmplxfft;
+
+	g_return_if_fail(GST_IS_CMPLXFFT(object));
+	cmplxfft = GST_CMPLXFFT(object);
+
+	switch(prop_id) {
+		case ARG_THREADS:
+			g_value_set_int(value, cmplxfft->threads);
+			break;
+		case ARG_BATCH:
+			g_value_set_int(value, cmplxfft->batch);
+			break;
+		case ARG_FPS:
+			g_value_set_float(value, cmplxfft->fps);
+			break;
+		case ARG_OVERLAP:
+			g_value_set_int(value, cmplxfft->overlap);
+			break;
+		case ARG_WINDOW:
+			g_value_set_int(value, cmplxfft->window);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
 	}
-	cmplxfft->buffer = NULL;
-	if (cmplxfft->length < 2)
-		return -1;
-	cmplxfft->buffer = fftwf_malloc(sizeof(fftwf_complex) * n);
-	if (!cmplxfft->buffer)
-		return -1;
-	cmplxfft->plan = fftwf_plan_dft_1d(n, cmplxfft->buffer,
-	    cmplxfft->buffer, FFTW_FORWARD, FFTW_MEASURE);
-	cmplxfft->fill = 0;
-	return 0;
 }
 
 static GstStateChangeReturn gst_cmplxfft_change_state(GstElement *element,
@@ -134,6 +419,17 @@ static gboolean gst_cmplxfft_setcaps(GstPad *pad, GstCaps *caps)
 	cmplxfft = GST_CMPLXFFT(gst_pad_get_parent(pad));
 	structure = gst_caps_get_structure(caps, 0);
 	gst_structure_get_int(structure, "rate", &rate);
+	cmplxfft->rate = rate;
+
+	if (pad == cmplxfft->sinkpad) {
+		int real = !strcmp(gst_structure_get_name(structure),
+		    "audio/x-raw-float");
+
+		if (real != cmplxfft->real) {
+			cmplxfft->real = real;
+			gst_cmplxfft_setup(cmplxfft);
+		}
+	}
 
 	if (pad == cmplxfft->srcpad) {
 		gst_structure_get_int(structure, "length", &cmplxfft->length);
@@ -163,6 +459,26 @@ static void gst_cmplxfft_class_init(Gst_cmplxfft_class *klass)
 
 	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 
+	gobject_class->set_property = gst_cmplxfft_set_property;
+	gobject_class->get_property = gst_cmplxfft_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_THREADS,
+	    g_param_spec_int("threads", "threads", "threads", 1, 64, 1,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_BATCH,
+	    g_param_spec_int("batch", "batch", "batch", 1, 4096, 1,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_FPS,
+	    g_param_spec_float("fps", "fps", "fps", 0.0, G_MAXFLOAT, 0.0,
+	    G_PARAM_READABLE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_OVERLAP,
+	    g_param_spec_int("overlap", "overlap", "overlap", 1, 64, 1,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_WINDOW,
+	    g_param_spec_int("window", "window", "window",
+	    WINDOW_RECTANGULAR, WINDOW_SQRTHANN, WINDOW_RECTANGULAR,
+	    G_PARAM_READWRITE));
+
 	gstelement_class->change_state = gst_cmplxfft_change_state;
 
 	gst_element_class_set_details(gstelement_class, &cmplxfft_details);
@@ -189,9 +505,24 @@ static void gst_cmplxfft_init(Gst_cmplxfft *cmplxfft)
 	gst_pad_set_setcaps_function(cmplxfft->srcpad, gst_cmplxfft_setcaps);
 
 	cmplxfft->buffer = NULL;
+	cmplxfft->rbuffer = NULL;
+	cmplxfft->batchplan = NULL;
+	cmplxfft->win = NULL;
+	cmplxfft->tail = NULL;
 	cmplxfft->length = 512;
+	cmplxfft->rate = 0;
+	cmplxfft->real = 0;
+	cmplxfft->batch = 1;
+	cmplxfft->threads = 1;
+	cmplxfft->overlap = 1;
+	cmplxfft->hop = 512;
+	cmplxfft->window = WINDOW_RECTANGULAR;
+	cmplxfft->reconfigure = 0;
 	gst_cmplxfft_setup(cmplxfft);
 	cmplxfft->offset = 0;
+	cmplxfft->timer = g_timer_new();
+	cmplxfft->frames = 0;
+	cmplxfft->fps = 0.0;
 }
 
 GType gst_cmplxfft_get_type(void)
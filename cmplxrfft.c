@@ -13,6 +13,7 @@
 #include <fftw3.h>
 #include "gstiq.h"
 #include <string.h>
+#include <stdlib.h>
 
 static GstElementDetails cmplxrfft_details = GST_ELEMENT_DETAILS(
 	"Complex Reverse FFT plugin",
@@ -30,6 +31,13 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 		"endianness = (int) BYTE_ORDER, "
 		"depth = (int) 64, "
 		"channels = (int) 1, "
+		"rate = (int) [ 1, MAX ]; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"channels = (int) 1, "
 		"rate = (int) [ 1, MAX ] "
 	)
 );
@@ -48,16 +56,176 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 	)
 );
 
+enum {
+	ARG_0,
+	ARG_OVERLAP,
+	ARG_WINDOW,
+};
+
 static GstElementClass *parent_class = NULL;
 
+/*
+ *	Window the inverse transform and add it to the overlap-add
+ *	accumulator. The first length/overlap samples are complete after
+ *	this and are copied to 'out', the rest is shifted down for the
+ *	next frames.
+ *	'in' holds 'c' floats per sample: 2 for complex, 1 for real output.
+ */
+static void gst_cmplxrfft_ola(Gst_cmplxrfft *cmplxrfft, float *in, int c,
+    float *out)
+{
+	float *ola = (float *)cmplxrfft->ola;
+	float *win = cmplxrfft->win;
+	int n = cmplxrfft->length;
+	int hop = cmplxrfft->hop;
+	int k;
+
+	if (c == 2) {
+		for (k = 0; k < n; k++) {
+			ola[k*2] += in[k*2] * win[k];
+			ola[k*2+1] += in[k*2+1] * win[k];
+		}
+	} else {
+		for (k = 0; k < n; k++)
+			ola[k] += in[k] * win[k];
+	}
+	memcpy(out, ola, hop * c * sizeof(float));
+	memmove(ola, ola + hop * c, (n - hop) * c * sizeof(float));
+	memset(ola + (n - hop) * c, 0, hop * c * sizeof(float));
+}
+
+/*
+ *	Real output is used when downstream does not take complex samples.
+ *	Complex comes first in the src template, so this only happens
+ *	when the first format both sides allow is audio/x-raw-float.
+ */
+static int gst_cmplxrfft_real(Gst_cmplxrfft *cmplxrfft)
+{
+	GstCaps *caps;
+	int real = 0;
+
+	caps = gst_pad_get_allowed_caps(cmplxrfft->srcpad);
+	if (!caps)
+		return 0;
+	if (!gst_caps_is_empty(caps))
+		real = gst_structure_has_name(gst_caps_get_structure(caps, 0),
+		    "audio/x-raw-float");
+	gst_caps_unref(caps);
+	return real;
+}
+
+/*
+ *	Tell upstream when the spectrum only has to be valid in its lower
+ *	half: the c2r transform takes the upper half to be the complex
+ *	conjugate mirror.
+ */
+static GstCaps *gst_cmplxrfft_getcaps(GstPad *pad)
+{
+	Gst_cmplxrfft *cmplxrfft;
+	GstCaps *caps;
+
+	cmplxrfft = GST_CMPLXRFFT(gst_pad_get_parent(pad));
+	caps = gst_caps_copy(gst_pad_get_pad_template_caps(pad));
+	if (gst_cmplxrfft_real(cmplxrfft))
+		gst_structure_set(gst_caps_get_structure(caps, 0),
+		    "hermitian", G_TYPE_BOOLEAN, TRUE, NULL);
+	gst_object_unref(cmplxrfft);
+	return caps;
+}
+
+/* Run the inverse transform, returns the time domain samples */
+static float *gst_cmplxrfft_execute(Gst_cmplxrfft *cmplxrfft)
+{
+	if (cmplxrfft->real) {
+		fftwf_execute_dft_c2r(cmplxrfft->plan,
+		    cmplxrfft->buffer, cmplxrfft->rbuffer);
+		return cmplxrfft->rbuffer;
+	}
+	fftwf_execute_dft(cmplxrfft->plan,
+	    cmplxrfft->buffer, cmplxrfft->buffer);
+	return (float *)cmplxrfft->buffer;
+}
+
+static int gst_cmplxrfft_setup(Gst_cmplxrfft *cmplxrfft)
+{
+	int n = cmplxrfft->length;
+
+	GST_OBJECT_LOCK(cmplxrfft);
+	cmplxrfft->reconfigure = 0;
+	GST_OBJECT_UNLOCK(cmplxrfft);
+
+	if (cmplxrfft->buffer) {
+		fftwf_free(cmplxrfft->buffer);
+		if (cmplxrfft->rbuffer)
+			fftwf_free(cmplxrfft->rbuffer);
+		iqfftplan_put(cmplxrfft->plan);
+	}
+	if (cmplxrfft->win)
+		free(cmplxrfft->win);
+	if (cmplxrfft->ola)
+		free(cmplxrfft->ola);
+	cmplxrfft->buffer = NULL;
+	cmplxrfft->rbuffer = NULL;
+	cmplxrfft->win = NULL;
+	cmplxrfft->ola = NULL;
+	if (cmplxrfft->length < 2)
+		return -1;
+	if (cmplxrfft->overlap > n)
+		cmplxrfft->overlap = n;
+	cmplxrfft->hop = n / cmplxrfft->overlap;
+	if (cmplxrfft->overlap > 1 ||
+	    cmplxrfft->window != WINDOW_RECTANGULAR) {
+		cmplxrfft->win = iqwindow_synthesis(cmplxrfft->window, n,
+		    cmplxrfft->overlap);
+		cmplxrfft->ola = calloc(n, sizeof(fftwf_complex));
+		if (!cmplxrfft->win || !cmplxrfft->ola)
+			return -1;
+	}
+	cmplxrfft->buffer = fftwf_malloc(sizeof(fftwf_complex) * n);
+	if (!cmplxrfft->buffer)
+		return -1;
+	if (cmplxrfft->real) {
+		/* c2r only reads bins 0 to n/2 */
+		cmplxrfft->rbuffer = fftwf_malloc(sizeof(float) * n);
+		if (!cmplxrfft->rbuffer) {
+			fftwf_free(cmplxrfft->buffer);
+			cmplxrfft->buffer = NULL;
+			return -1;
+		}
+		cmplxrfft->plan = iqfftplan_get(FFTPLAN_C2R, n, 1, 1,
+		    cmplxrfft->buffer, cmplxrfft->rbuffer);
+	} else {
+		cmplxrfft->plan = iqfftplan_get(FFTPLAN_BACKWARD, n, 1, 1,
+		    cmplxrfft->buffer, cmplxrfft->buffer);
+	}
+	if (!cmplxrfft->plan) {
+		fftwf_free(cmplxrfft->buffer);
+		if (cmplxrfft->rbuffer)
+			fftwf_free(cmplxrfft->rbuffer);
+		cmplxrfft->buffer = NULL;
+		cmplxrfft->rbuffer = NULL;
+		return -1;
+	}
+	cmplxrfft->fill = 0;
+	return 0;
+}
+
 static GstFlowReturn gst_cmplxrfft_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_cmplxrfft *cmplxrfft;
 	GstBuffer *outbuf;
 	GstCaps *caps;
-	int i, j;
+	float *out;
+	int i, j, c, outlen;
+	int reconfigure;
 
 	cmplxrfft = GST_CMPLXRFFT(gst_pad_get_parent(pad));
+	/* New properties: rebuild the buffers here, not under our feet */
+	GST_OBJECT_LOCK(cmplxrfft);
+	reconfigure = cmplxrfft->reconfigure;
+	GST_OBJECT_UNLOCK(cmplxrfft);
+	if (reconfigure)
+		gst_cmplxrfft_setup(cmplxrfft);
 	if (cmplxrfft->buffer) {
 		j = 0;
 		while (j < GST_BUFFER_SIZE(buf)/sizeof(fftwf_complex)) {
@@ -71,11 +239,17 @@ static GstFlowReturn gst_cmplxrfft_chain(GstPad *pad, GstBuffer *buf)
 			cmplxrfft->fill += i;
 			if (cmplxrfft->fill >= cmplxrfft->length) {
 				cmplxrfft->fill = 0;
+				outlen = cmplxrfft->hop;
+				c = cmplxrfft->real ? 1 : 2;
 				outbuf = gst_buffer_new_and_alloc(
-				    cmplxrfft->length * sizeof(fftwf_complex));
-				fftwf_execute(cmplxrfft->plan);
-				memcpy(GST_BUFFER_DATA(outbuf), cmplxrfft->buffer,
-				    sizeof(fftwf_complex) * cmplxrfft->length);
+				    outlen * c * sizeof(float));
+				out = gst_cmplxrfft_execute(cmplxrfft);
+				if (cmplxrfft->win)
+					gst_cmplxrfft_ola(cmplxrfft, out, c,
+					    (float *)GST_BUFFER_DATA(outbuf));
+				else
+					memcpy(GST_BUFFER_DATA(outbuf), out,
+					    outlen * c * sizeof(float));
 				caps = gst_pad_get_caps(cmplxrfft->srcpad);
 				gst_buffer_set_caps(outbuf, caps);
 				gst_caps_unref(caps);
@@ -92,24 +266,51 @@ static GstFlowReturn gst_cmplxrfft_chain(GstPad *pad, GstBuffer *buf)
 	return GST_FLOW_OK;
 }
 
-static int gst_cmplxrfft_setup(Gst_cmplxrfft *cmplxrfft)
+static void gst_cmplxrfft_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
 {
-	int n = cmplxrfft->length;
+	Gst_cmplxrfft *cmplxrfft;
 
-	if (cmplxrfft->buffer) {
-		fftwf_free(cmplxrfft->buffer);
-		fftwf_destroy_plan(cmplxrfft->plan);
+	g_return_if_fail(GST_IS_CMPLXRFFT(object));
+	cmplxrfft = GST_CMPLXRFFT(object);
+
+	switch(prop_id) {
+		case ARG_OVERLAP:
+			GST_OBJECT_LOCK(cmplxrfft);
+			cmplxrfft->overlap = g_value_get_int(value);
+			cmplxrfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxrfft);
+			break;
+		case ARG_WINDOW:
+			GST_OBJECT_LOCK(cmplxrfft);
+			cmplxrfft->window = g_value_get_int(value);
+			cmplxrfft->reconfigure = 1;
+			GST_OBJECT_UNLOCK(cmplxrfft);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_cmplxrfft_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_cmplxrfft *cmplxrfft;
+
+	g_return_if_fail(GST_IS_CMPLXRFFT(object));
+	cmplxrfft = GST_CMPLXRFFT(object);
+
+	switch(prop_id) {
+		case ARG_OVERLAP:
+			g_value_set_int(value, cmplxrfft->overlap);
+			break;
+		case ARG_WINDOW:
+			g_value_set_int(value, cmplxrfft->window);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
 	}
-	cmplxrfft->buffer = NULL;
-	if (cmplxrfft->length < 2)
-		return -1;
-	cmplxrfft->buffer = fftwf_malloc(sizeof(fftwf_complex) * n);
-	if (!cmplxrfft->buffer)
-		return -1;
-	cmplxrfft->plan = fftwf_plan_dft_1d(n, cmplxrfft->buffer,
-	    cmplxrfft->buffer, FFTW_BACKWARD, FFTW_MEASURE);
-	cmplxrfft->fill = 0;
-	return 0;
 }
 
 static GstStateChangeReturn gst_cmplxrfft_change_state(GstElement *element,
@@ -130,10 +331,13 @@ static gboolean gst_cmplxrfft_setcaps(GstPad *pad, GstCaps *caps)
 	structure = gst_caps_get_structure(caps, 0);
 	gst_structure_get_int(structure, "rate", &rate);
 	gst_structure_get_int(structure, "length", &cmplxrfft->length);
+	cmplxrfft->real = gst_cmplxrfft_real(cmplxrfft);
 
 	gst_cmplxrfft_setup(cmplxrfft);
 
-	newcaps = gst_caps_copy(gst_pad_get_caps(cmplxrfft->srcpad));
+	newcaps = gst_caps_copy_nth(
+	    gst_static_pad_template_get_caps(&src_template),
+	    cmplxrfft->real ? 1 : 0);
 	structure = gst_caps_get_structure(newcaps, 0);
 	gst_structure_set(structure, "rate", G_TYPE_INT, rate, NULL);
 
@@ -154,6 +358,17 @@ static void gst_cmplxrfft_class_init(Gst_cmplxrfft_class *klass)
 
 	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
 
+	gobject_class->set_property = gst_cmplxrfft_set_property;
+	gobject_class->get_property = gst_cmplxrfft_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_OVERLAP,
+	    g_param_spec_int("overlap", "overlap", "overlap", 1, 64, 1,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_WINDOW,
+	    g_param_spec_int("window", "window", "window",
+	    WINDOW_RECTANGULAR, WINDOW_SQRTHANN, WINDOW_RECTANGULAR,
+	    G_PARAM_READWRITE));
+
 	gstelement_class->change_state = gst_cmplxrfft_change_state;
 
 	gst_element_class_set_details(gstelement_class, &cmplxrfft_details);
@@ -177,9 +392,18 @@ static void gst_cmplxrfft_init(Gst_cmplxrfft *cmplxrfft)
 	gst_element_add_pad(GST_ELEMENT(cmplxrfft), cmplxrfft->srcpad);
 
 	gst_pad_set_setcaps_function(cmplxrfft->sinkpad, gst_cmplxrfft_setcaps);
+	gst_pad_set_getcaps_function(cmplxrfft->sinkpad, gst_cmplxrfft_getcaps);
 
 	cmplxrfft->buffer = NULL;
+	cmplxrfft->rbuffer = NULL;
+	cmplxrfft->win = NULL;
+	cmplxrfft->ola = NULL;
+	cmplxrfft->real = 0;
 	cmplxrfft->length = 512;
+	cmplxrfft->overlap = 1;
+	cmplxrfft->window = WINDOW_RECTANGULAR;
+	cmplxrfft->hop = 512;
+	cmplxrfft->reconfigure = 0;
 	gst_cmplxrfft_setup(cmplxrfft);
 	cmplxrfft->offset = 0;
 }
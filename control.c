@@ -0,0 +1,113 @@
+/*
+ *	Named control values shared between elements.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	A control is a single float with a name, for loops that close
+ *	inside a pipeline (afc steering iqfshift) without a trip through
+ *	the application. One element writes it, any number read it.
+ *	Setting and reading are a pair of atomic operations, no locks and
+ *	no allocations. Only finding a control by name takes the registry
+ *	lock, elements do that when the property is set.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include "gstiq.h"
+
+struct iqcontrol {
+	struct iqcontrol *next;
+
+	char *name;
+	int refs;
+
+	volatile gint value;	/* bits of the float */
+	volatile gint seq;	/* incremented on every set */
+};
+
+static struct iqcontrol *iqcontrols = NULL;
+G_LOCK_DEFINE_STATIC(iqcontrols);
+
+struct iqcontrol *iqcontrol_get(const char *name)
+{
+	struct iqcontrol *entry;
+
+	if (!name || !*name)
+		return NULL;
+
+	G_LOCK(iqcontrols);
+	for (entry = iqcontrols; entry; entry = entry->next) {
+		if (!strcmp(entry->name, name)) {
+			entry->refs++;
+			goto out;
+		}
+	}
+
+	entry = malloc(sizeof(struct iqcontrol));
+	if (!entry)
+		goto out;
+	entry->name = g_strdup(name);
+	entry->refs = 1;
+	entry->value = 0;
+	entry->seq = 0;
+	entry->next = iqcontrols;
+	iqcontrols = entry;
+out:
+	G_UNLOCK(iqcontrols);
+	return entry;
+}
+
+void iqcontrol_put(struct iqcontrol *control)
+{
+	struct iqcontrol **entryp, *entry;
+
+	if (!control)
+		return;
+	G_LOCK(iqcontrols);
+	for (entryp = &iqcontrols; *entryp; entryp = &(*entryp)->next) {
+		entry = *entryp;
+		if (entry != control)
+			continue;
+		if (--entry->refs == 0) {
+			*entryp = entry->next;
+			g_free(entry->name);
+			free(entry);
+		}
+		break;
+	}
+	G_UNLOCK(iqcontrols);
+}
+
+void iqcontrol_set(struct iqcontrol *control, float value)
+{
+	union { float f; gint i; } v;
+
+	v.f = value;
+	g_atomic_int_set(&control->value, v.i);
+	g_atomic_int_inc(&control->seq);
+}
+
+/*
+ *	Returns TRUE and the value when it was set since the reader last
+ *	saw it, '*seq' keeps track of that for the reader.
+ */
+gboolean iqcontrol_read(struct iqcontrol *control, float *value, gint *seq)
+{
+	union { float f; gint i; } v;
+	gint s;
+
+	s = g_atomic_int_get(&control->seq);
+	if (s == *seq)
+		return FALSE;
+	v.i = g_atomic_int_get(&control->value);
+	*seq = s;
+	*value = v.f;
+	return TRUE;
+}
@@ -13,7 +13,7 @@
 #include <fftw3.h>
 #include "gstiq.h"
 #include <string.h>
-#include <complex.h>
+#include <stdlib.h>
 
 static GstElementDetails iqfdemod_details = GST_ELEMENT_DETAILS(
 	"Frequency domain demodulator",
@@ -26,6 +26,7 @@ enum {
 	ARG_0,
 	ARG_OFFSET,
 	ARG_MODE,
+	ARG_BFO,
 };
 
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
@@ -38,7 +39,14 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 		"rate = (int) [ 1, MAX ], "
 		"channels = (int) 1, "
 		"length = (int) [ 1, MAX ], "
-		"endianness = (int) BYTE_ORDER "
+		"endianness = (int) BYTE_ORDER; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"channels = (int) 1, "
+		"rate = (int) [ 1, MAX ] "
 	)
 );
 
@@ -58,23 +66,383 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 
 static GstElementClass *parent_class = NULL;
 
-static int gst_iqfdemod_setup(Gst_iqfdemod *fdemod)
+void fdemod_table_free(struct fdemod_table *table)
 {
+	if (table->gain)
+		free(table->gain);
+	if (table->gaps)
+		free(table->gaps);
+	table->gain = NULL;
+	table->gaps = NULL;
+	table->length = 0;
+	table->copies = 0;
+	table->ngaps = 0;
+	table->mirror = FDEMOD_MIRROR_NONE;
+}
+
+/*
+ *	Output bin 'o' (negative for the upper half) is taken from input
+ *	bin 'o + bin' in all modes. LSB is the part below the offset,
+ *	mirrored into the upper half of the output. CW is USB with the
+ *	carrier moved up to 'bfo' Hz and only a narrow band around it.
+ *	AM and FM need a time domain stage after the inverse transform,
+ *	as spectra their output is all zero; iqfdemod maps them as RAW
+ *	when it does that stage itself.
+ *	Everything that depends on the mode, offset and lengths is worked
+ *	out here: the passband gain for each output bin, at most three runs
+ *	that are contiguous in both spectra (split where either index wraps
+ *	around) and the output bins that stay zero.
+ *	'binwidth' is the spacing of the bins in Hz, not necessarily a
+ *	whole number. The offset goes to the nearest bin, the caller is
+ *	left with less than half a bin to take out.
+ */
+int fdemod_table_setup(struct fdemod_table *table, int mode,
+    int foffset, int sinklength, int srclength, double binwidth,
+    int hermitian, int bfo)
+{
+	struct fdemod_span *span;
+	char *used;
+	float f1 = 0.0, f2 = 0.0;
+	int len = srclength / 2;
+	int o0 = 0, o1 = 0, wrap = 0, reverse = 0;
+	int lo, hi, a, b, o, i, bin;
+	int cut[4], cuts;
+	int bfobin = 0, cwbins = 0;
+
+	fdemod_table_free(table);
+	if (srclength < 1 || sinklength < 1 || binwidth <= 0.0)
+		return -1;
+	table->gain = calloc(srclength, sizeof(float));
+	used = calloc(srclength, 1);
+	if (!table->gain || !used) {
+		if (used)
+			free(used);
+		fdemod_table_free(table);
+		return -1;
+	}
+	table->length = srclength;
+	table->half = len;
+
+	bin = lround(foffset / binwidth);
+	f1 = 300.0 / binwidth;
+	f2 = 3000.0 / binwidth;
+	bfobin = lround(bfo / binwidth);
+	cwbins = FDEMOD_CW_WIDTH / 2 / binwidth;
+	switch (mode) {
+		case FDEMOD_RAW:
+			o0 = -(srclength / 2);
+			o1 = srclength / 2;
+			wrap = srclength;
+			break;
+		case FDEMOD_USB:
+			o0 = 1;
+			o1 = len;
+			wrap = len + len;
+			if (!hermitian)
+				table->mirror = FDEMOD_MIRROR_UPPER;
+			break;
+		case FDEMOD_LSB:
+			o0 = 1 - len;
+			o1 = 0;
+			wrap = len + len;
+			/* Downstream only reads the lower half, write there */
+			if (hermitian)
+				reverse = 1;
+			else
+				table->mirror = FDEMOD_MIRROR_LOWER;
+			break;
+		case FDEMOD_CW:
+			o0 = bfobin - cwbins > 1 ? bfobin - cwbins : 1;
+			o1 = bfobin + cwbins + 1 < len ? bfobin + cwbins + 1 : len;
+			wrap = len + len;
+			bin -= bfobin;
+			if (!hermitian)
+				table->mirror = FDEMOD_MIRROR_UPPER;
+			break;
+	}
+	table->bin = bin;
+
+	for (o = o0; o < o1; o++) {
+		i = reverse ? -o : (o < 0 ? o + wrap : o);
+		if (mode == FDEMOD_RAW) {
+			table->gain[i] = 1.0;
+		} else if (mode == FDEMOD_CW) {
+			table->gain[i] = 2.0;
+		} else {
+			a = o < 0 ? -o : o;
+			table->gain[i] = 2.0
+			    * (float)a / (f1+(float)(a))
+			    * ((float)(len-a)) / (f2+(float)(len-a));
+		}
+	}
+
+	/* Only input bins -sinklength/2 up to sinklength/2 exist */
+	lo = o0 > -(sinklength/2) - bin ? o0 : -(sinklength/2) - bin;
+	hi = o1 < sinklength/2 - bin ? o1 : sinklength/2 - bin;
+	cuts = 0;
+	cut[cuts++] = lo;
+	if (0 > lo && 0 < hi)
+		cut[cuts++] = 0;
+	if (-bin > lo && -bin < hi && bin != 0)
+		cut[cuts++] = -bin;
+	if (cuts == 3 && cut[1] > cut[2]) {
+		cut[2] = cut[1];
+		cut[1] = -bin;
+	}
+	cut[cuts] = hi;
+	for (i = 0; i < cuts; i++) {
+		a = cut[i];
+		b = cut[i+1];
+		if (b <= a)
+			continue;
+		span = &table->copy[table->copies++];
+		span->src = a + bin < 0 ? a + bin + sinklength : a + bin;
+		span->dst = reverse ? -a : (a < 0 ? a + wrap : a);
+		span->len = b - a;
+		span->reverse = reverse;
+		for (o = a; o < b; o++)
+			used[reverse ? -o : (o < 0 ? o + wrap : o)] = 1;
+	}
+
+	if (table->mirror == FDEMOD_MIRROR_UPPER)
+		for (i = 1; i < len; i++)
+			used[len + len - i] = 1;
+	if (table->mirror == FDEMOD_MIRROR_LOWER)
+		for (i = 1; i < len; i++)
+			used[i] = 1;
+
+	for (i = 0; i < srclength; i++) {
+		if (used[i] || (i && !used[i-1]))
+			continue;
+		table->gaps = realloc(table->gaps,
+		    sizeof(struct fdemod_span) * (table->ngaps + 1));
+		span = &table->gaps[table->ngaps++];
+		span->dst = i;
+		for (span->len = 0; i + span->len < srclength &&
+		    !used[i + span->len]; span->len++);
+	}
+	free(used);
 	return 0;
 }
 
+/* Fill one output spectrum from one input spectrum */
+void fdemod_table_process(struct fdemod_table *table,
+    const float *in, float *out)
+{
+	struct fdemod_span *span;
+	const float *src;
+	const float *gain;
+	float *dst;
+	int half = table->half;
+	int i, k;
+
+	for (i = 0; i < table->ngaps; i++)
+		memset(out + table->gaps[i].dst * 2, 0,
+		    table->gaps[i].len * sizeof(float) * 2);
+	for (i = 0; i < table->copies; i++) {
+		span = &table->copy[i];
+		src = in + span->src * 2;
+		if (span->reverse) {
+			for (k = 0; k < span->len; k++) {
+				out[(span->dst-k)*2] = src[k*2]
+				    * table->gain[span->dst-k];
+				out[(span->dst-k)*2+1] = -src[k*2+1]
+				    * table->gain[span->dst-k];
+			}
+			continue;
+		}
+		dst = out + span->dst * 2;
+		gain = table->gain + span->dst;
+		for (k = 0; k < span->len; k++) {
+			dst[k*2] = src[k*2] * gain[k];
+			dst[k*2+1] = src[k*2+1] * gain[k];
+		}
+	}
+	if (table->mirror == FDEMOD_MIRROR_UPPER) {
+		for (k = 1; k < half; k++) {
+			out[(half+half-k)*2] = out[k*2];
+			out[(half+half-k)*2+1] = -out[k*2+1];
+		}
+	}
+	if (table->mirror == FDEMOD_MIRROR_LOWER) {
+		for (k = 1; k < half; k++) {
+			out[k*2] = out[(half+half-k)*2];
+			out[k*2+1] = -out[(half+half-k)*2+1];
+		}
+	}
+}
+
+static int gst_iqfdemod_setup(Gst_iqfdemod *fdemod)
+{
+	int mode = fdemod->mode;
+	int ret;
+	double bw = 0.0, rate = 0.0, df;
+
+	GST_OBJECT_LOCK(fdemod);
+	if (fdemod->spectrum) {
+		fftwf_free(fdemod->spectrum);
+		free(fdemod->audiobuf);
+		iqfftplan_put(fdemod->plan);
+	}
+	fdemod->spectrum = NULL;
+	fdemod->audiobuf = NULL;
+	if (fdemod->audio && fdemod->sinkrate && fdemod->sinklength) {
+		/* AM and FM take the complex channel around the offset */
+		if (mode == FDEMOD_AM || mode == FDEMOD_FM)
+			mode = FDEMOD_RAW;
+		/* The inverse runs at a rate of srclength input bins */
+		bw = (double)fdemod->sinkrate / fdemod->sinklength;
+		rate = fdemod->srclength * bw;
+		if (fdemod->srclength > 0) {
+			fdemod->spectrum = fftwf_malloc(
+			    sizeof(fftwf_complex) * fdemod->srclength);
+			fdemod->audiobuf = malloc(
+			    sizeof(float) * fdemod->srclength);
+		}
+		if (fdemod->spectrum && fdemod->audiobuf)
+			fdemod->plan = iqfftplan_get(FFTPLAN_BACKWARD,
+			    fdemod->srclength, 1, 1,
+			    fdemod->spectrum, fdemod->spectrum);
+		if (fdemod->spectrum && (!fdemod->audiobuf || !fdemod->plan)) {
+			fftwf_free(fdemod->spectrum);
+			free(fdemod->audiobuf);
+			fdemod->spectrum = NULL;
+			fdemod->audiobuf = NULL;
+		}
+		fdemod->step = rate / fdemod->srcrate;
+		fdemod->dcalpha = 1.0 - exp(-2 * M_PI * FDEMOD_AM_DC / rate);
+	} else if (fdemod->sinkrate && fdemod->sinklength) {
+		/* The offset is in bins of the input spectrum */
+		bw = (double)fdemod->sinkrate / fdemod->sinklength;
+	} else if (fdemod->srclength > 0) {
+		bw = (double)fdemod->srcrate / fdemod->srclength;
+	}
+	/* Audio keeps the analytic signal, the mirror is not needed */
+	ret = fdemod_table_setup(&fdemod->table, mode,
+	    fdemod->foffset, fdemod->sinklength, fdemod->srclength,
+	    bw, fdemod->audio ? TRUE : fdemod->hermitian,
+	    fdemod->bfo);
+	if (rate > 0.0) {
+		/*
+		 * Whole bins are shifted in the spectrum, what is left of
+		 * the offset is rotated out after the inverse transform.
+		 */
+		df = fdemod->foffset - fdemod->table.bin * bw;
+		if (mode == FDEMOD_CW)
+			df -= fdemod->bfo;
+		if (mode == FDEMOD_LSB)
+			df = -df;
+		fdemod->drot[0] = cos(-2 * M_PI * df / rate);
+		fdemod->drot[1] = sin(-2 * M_PI * df / rate);
+	}
+	GST_OBJECT_UNLOCK(fdemod);
+	return ret;
+}
+
+/*
+ *	Audio output: the selected bins are transformed back to a short
+ *	complex frame, rotated by the part of the offset that is not a
+ *	whole bin and demodulated sample by sample. The result is
+ *	interpolated to the output rate, which does not have to be a whole
+ *	number of bins.
+ *	The frames of the input spectra have to follow each other without
+ *	overlap. Returns the number of output samples.
+ */
+static int gst_iqfdemod_audio(Gst_iqfdemod *fdemod, const float *in,
+    float *out)
+{
+	float *z = (float *)fdemod->spectrum;
+	float *y = fdemod->audiobuf;
+	float re, im, pre, pim, rr, ri, mag;
+	double pos;
+	int n = fdemod->srclength;
+	int i, k;
+
+	fdemod_table_process(&fdemod->table, in, z);
+	fftwf_execute_dft(fdemod->plan, fdemod->spectrum, fdemod->spectrum);
+
+	rr = fdemod->rot[0];
+	ri = fdemod->rot[1];
+	for (i = 0; i < n; i++) {
+		re = z[i*2] * rr - z[i*2+1] * ri;
+		im = z[i*2] * ri + z[i*2+1] * rr;
+		z[i*2] = re;
+		z[i*2+1] = im;
+		re = rr * fdemod->drot[0] - ri * fdemod->drot[1];
+		ri = rr * fdemod->drot[1] + ri * fdemod->drot[0];
+		rr = re;
+	}
+	mag = sqrtf(rr * rr + ri * ri);
+	fdemod->rot[0] = rr / mag;
+	fdemod->rot[1] = ri / mag;
+
+	switch (fdemod->mode) {
+		case FDEMOD_AM:
+			for (i = 0; i < n; i++) {
+				re = sqrtf(z[i*2] * z[i*2] +
+				    z[i*2+1] * z[i*2+1]);
+				fdemod->dc += (re - fdemod->dc) * fdemod->dcalpha;
+				y[i] = re - fdemod->dc;
+			}
+			break;
+		case FDEMOD_FM:
+			pre = fdemod->prev[0];
+			pim = fdemod->prev[1];
+			for (i = 0; i < n; i++) {
+				/* phase step: z[i] * conj(z[i-1]) */
+				re = z[i*2] * pre + z[i*2+1] * pim;
+				im = z[i*2+1] * pre - z[i*2] * pim;
+				y[i] = atan2f(im, re) * M_1_PI;
+				pre = z[i*2];
+				pim = z[i*2+1];
+			}
+			fdemod->prev[0] = pre;
+			fdemod->prev[1] = pim;
+			break;
+		case FDEMOD_RAW:
+			for (i = 0; i < n; i++)
+				y[i] = z[i*2];
+			break;
+		default:
+			/* Single sideband: the real part is half of it */
+			for (i = 0; i < n; i++)
+				y[i] = 2 * z[i*2];
+			break;
+	}
+
+	/* Linear interpolation, position -1 is the previous frame's last */
+	pos = fdemod->pos;
+	for (k = 0; pos < n - 1; k++, pos += fdemod->step) {
+		i = floor(pos);
+		re = i < 0 ? fdemod->last : y[i];
+		out[k] = re + (pos - i) * (y[i+1] - re);
+	}
+	fdemod->pos = pos - n;
+	fdemod->last = y[n-1];
+	return k;
+}
+
+/*
+ *	Audio output with a rate chosen downstream, 8000 Hz if it does not
+ *	care. The output spectrum keeps the bin width of the input.
+ */
+static void gst_iqfdemod_audiocaps(Gst_iqfdemod *fdemod, GstCaps *allowed)
+{
+	GstCaps *caps;
+
+	caps = gst_caps_copy_nth(allowed, 0);
+	gst_structure_fixate_field_nearest_int(gst_caps_get_structure(caps, 0),
+	    "rate", FDEMOD_AUDIO_RATE);
+	gst_pad_set_caps(fdemod->srcpad, caps);
+	gst_caps_unref(caps);
+}
+
 static GstFlowReturn gst_iqfdemod_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_iqfdemod *fdemod;
 	GstBuffer *outbuf;
 	GstCaps *caps;
-	int i, j;
-	complex float *outdata;
-	complex float *indata;
-	float factor;
-	int len;
-	float f1, f2;
-	int foffset;
+	int size;
 
 	fdemod = GST_IQFDEMOD(gst_pad_get_parent(pad));
 	caps = gst_pad_get_caps(fdemod->srcpad);
@@ -83,101 +451,54 @@ static GstFlowReturn gst_iqfdemod_chain(GstPad *pad, GstBuffer *buf)
 		gst_caps_unref(caps);
 		caps = gst_pad_get_allowed_caps(fdemod->srcpad);
 		structure = gst_caps_get_structure(caps, 0);
-		gst_structure_get_int(structure, "rate", &fdemod->srcrate);
-		gst_structure_get_int(structure, "length", &fdemod->srclength);
-		gst_iqfdemod_setup(fdemod);
+		if (gst_structure_has_name(structure, "audio/x-raw-float")) {
+			gst_iqfdemod_audiocaps(fdemod, caps);
+			gst_caps_unref(caps);
+			caps = gst_pad_get_caps(fdemod->srcpad);
+		} else {
+			fdemod->audio = 0;
+			gst_structure_get_int(structure, "rate",
+			    &fdemod->srcrate);
+			gst_structure_get_int(structure, "length",
+			    &fdemod->srclength);
+			if (!gst_structure_get_boolean(structure, "hermitian",
+			    &fdemod->hermitian))
+				fdemod->hermitian = FALSE;
+			gst_iqfdemod_setup(fdemod);
+		}
 	}
 
-	outbuf = gst_buffer_new_and_alloc(fdemod->srclength*sizeof(float) * 2);
+	if (fdemod->audio)
+		size = (fdemod->srclength / fdemod->step + 2) * sizeof(float);
+	else
+		size = fdemod->srclength * sizeof(float) * 2;
+	outbuf = gst_buffer_new_and_alloc(size);
 	if (!outbuf)
 		goto out;
-	outdata = (complex float *)GST_BUFFER_DATA(outbuf);
-	indata = (complex float *)GST_BUFFER_DATA(buf);
-
-	for (i = 0; i < fdemod->srclength; i++)
-		outdata[i] = 0.0;
-	
-	factor = 1.0;
-	
-	foffset = fdemod->foffset / (fdemod->srcrate / fdemod->srclength);
-	switch (fdemod->mode) {
-		case FDEMOD_RAW:
-			for (i = -(fdemod->srclength/2), 
-			    j = foffset -(fdemod->srclength/2);
-			     i < fdemod->srclength/2; i++, j++) {
-				if (j < -(fdemod->sinklength)/2)
-					continue;
-				if (j >= fdemod->sinklength/2)
-					continue;
-				if (i >= 0 && j >= 0)
-					outdata[i] = indata[j] * factor;
-				if (i >= 0 && j < 0)
-					outdata[i] =
-					    indata[j + fdemod->sinklength] * factor;
-				if (i < 0 && j >= 0)
-					outdata[i + fdemod->srclength] =
-					    indata[j] * factor;
-				if (i < 0 && j < 0)
-					outdata[i + fdemod->srclength] =
-					    indata[j + fdemod->sinklength] * factor;
-			}
-			break;
-		case FDEMOD_USB:
-			outdata[0] = 0.0 + 0.0 * I;
-			outdata[fdemod->srclength-1] = 0.0 + 0.0 * I;
-			f1 = 300.0 / (fdemod->srcrate/fdemod->srclength);
-			f2 = 3000.0 / (fdemod->srcrate/fdemod->srclength);
-			len = fdemod->srclength/2;
-			for (i = 1, j = foffset + 1; i < len; i++, j++) {
-				factor = 2.0
-				    * (float)i / (f1+(float)(i))
-				    * ((float)(len-i)) / (f2+(float)(len-i));
-				if (j < -(fdemod->sinklength)/2)
-					continue;
-				if (j >= fdemod->sinklength/2)
-					continue;
-				if (j >= 0)
-					outdata[i] = indata[j] * factor;
-				else
-					outdata[i] =
-					    indata[j + fdemod->sinklength] * factor;
-				*(float *)&outdata[len+len-i] = *(float *)&outdata[i];
-				*((float *)(&outdata[len+len-i])+1) = -*((float *)(&outdata[i])+1);
-			}
-			break;
-		case FDEMOD_LSB:
-			outdata[0] = 0.0 + 0.0 * I;
-			outdata[fdemod->srclength-1] = 0.0 + 0.0 * I;
-			f1 = 300.0 / (fdemod->srcrate/fdemod->srclength);
-			f2 = 3000.0 / (fdemod->srcrate/fdemod->srclength);
-			len = fdemod->srclength/2;
-			for (i = 1, j = foffset - 1; i < len; i++, j--) {
-				factor = 2.0
-				    * (float)i / (f1+(float)(i))
-				    * ((float)(len-i)) / (f2+(float)(len-i));
-				if (j < -(fdemod->sinklength)/2)
-					continue;
-				if (j >= fdemod->sinklength/2)
-					continue;
-				if (j >= 0)
-					outdata[len+len-i] = indata[j] * factor;
-				else
-					outdata[len+len-i] =
-					    indata[j + fdemod->sinklength] * factor;
-				*(float *)&outdata[i] = *(float *)&outdata[len+len-i];
-				*((float *)(&outdata[i])+1) = -*((float *)(&outdata[len+len-i])+1);
-			}
-			break;
-		default:
-			for (i = 0; i < fdemod->srclength; i++)
-				outdata[i] = 0.0 + 0.0 * I;
-	}
 
+	GST_OBJECT_LOCK(fdemod);
+	if (fdemod->table.length != fdemod->srclength ||
+	    GST_BUFFER_SIZE(buf) < fdemod->sinklength * sizeof(float) * 2)
+		memset(GST_BUFFER_DATA(outbuf), 0, GST_BUFFER_SIZE(outbuf));
+	else if (!fdemod->audio)
+		fdemod_table_process(&fdemod->table,
+		    (float *)GST_BUFFER_DATA(buf),
+		    (float *)GST_BUFFER_DATA(outbuf));
+	else if (fdemod->spectrum)
+		GST_BUFFER_SIZE(outbuf) = sizeof(float) * gst_iqfdemod_audio(
+		    fdemod, (float *)GST_BUFFER_DATA(buf),
+		    (float *)GST_BUFFER_DATA(outbuf));
+	else
+		memset(GST_BUFFER_DATA(outbuf), 0, GST_BUFFER_SIZE(outbuf));
+	GST_OBJECT_UNLOCK(fdemod);
 
 	gst_buffer_set_caps(outbuf, caps);
 	gst_caps_unref(caps);
 	GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
-	fdemod->offset += fdemod->srclength;
+	if (fdemod->audio)
+		fdemod->offset += GST_BUFFER_SIZE(outbuf) / sizeof(float);
+	else
+		fdemod->offset += fdemod->srclength;
 	GST_BUFFER_OFFSET(outbuf) = fdemod->offset;
 	gst_pad_push(fdemod->srcpad, outbuf);
 out:
@@ -205,10 +526,35 @@ static gboolean gst_iqfdemod_setcaps(GstPad *pad, GstCaps *caps)
 
 	gst_structure_get_int(structure, "length", &length);
 	gst_structure_get_int(structure, "rate", &rate);
+	if (pad == fdemod->srcpad &&
+	    gst_structure_has_name(structure, "audio/x-raw-float")) {
+		/*
+		 * Enough output bins for the output rate, the last part
+		 * to the exact rate is done by interpolation.
+		 */
+		length = 0;
+		if (rate && fdemod->sinkrate)
+			length = ((gint64)rate * fdemod->sinklength +
+			    fdemod->sinkrate - 1) / fdemod->sinkrate;
+		if (length >= 2) {
+			fdemod->audio = 1;
+			fdemod->srclength = length;
+			fdemod->srcrate = rate;
+			gst_iqfdemod_setup(fdemod);
+		} else {
+			ret = FALSE;
+		}
+		gst_object_unref(fdemod);
+		return ret;
+	}
 	if (rate && length) {
 		if (pad == fdemod->srcpad) {
+			fdemod->audio = 0;
 			fdemod->srclength = length;
 			fdemod->srcrate = rate;
+			if (!gst_structure_get_boolean(structure, "hermitian",
+			    &fdemod->hermitian))
+				fdemod->hermitian = FALSE;
 		} else {
 			fdemod->sinklength = length;
 			fdemod->sinkrate = rate;
@@ -234,9 +580,15 @@ static void gst_iqfdemod_set_property(GObject *object, guint prop_id,
 	switch(prop_id) {
 		case ARG_OFFSET:
 			fdemod->foffset = g_value_get_int(value);
+			gst_iqfdemod_setup(fdemod);
 			break;
 		case ARG_MODE:
 			fdemod->mode = g_value_get_int(value);
+			gst_iqfdemod_setup(fdemod);
+			break;
+		case ARG_BFO:
+			fdemod->bfo = g_value_get_int(value);
+			gst_iqfdemod_setup(fdemod);
 			break;
 		default:
 			break;
@@ -258,6 +610,9 @@ static void gst_iqfdemod_get_property(GObject *object, guint prop_id,
 		case ARG_MODE:
 			g_value_set_int(value, fdemod->mode);
 			break;
+		case ARG_BFO:
+			g_value_set_int(value, fdemod->bfo);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -283,6 +638,9 @@ static void gst_iqfdemod_class_init(Gst_iqfdemod_class *klass)
 	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_MODE,
 	    g_param_spec_int("mode", "mode", "mode",
 	         0, G_MAXINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_BFO,
+	    g_param_spec_int("bfo", "bfo", "CW beat frequency in Hz",
+	         0, G_MAXINT, FDEMOD_CW_BFO, G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_iqfdemod_change_state;
 
@@ -318,9 +676,27 @@ static void gst_iqfdemod_init(Gst_iqfdemod *fdemod)
 	fdemod->sinkrate = 0;
 	fdemod->srcrate = 0;
 	fdemod->mode = FDEMOD_USB;
-	gst_iqfdemod_setup(fdemod);
 	fdemod->foffset = 0;
 	fdemod->offset = 0;
+	fdemod->hermitian = FALSE;
+	fdemod->table.gain = NULL;
+	fdemod->table.gaps = NULL;
+	fdemod->bfo = FDEMOD_CW_BFO;
+	fdemod->audio = 0;
+	fdemod->spectrum = NULL;
+	fdemod->dc = 0.0;
+	fdemod->dcalpha = 0.0;
+	fdemod->prev[0] = 0.0;
+	fdemod->prev[1] = 0.0;
+	fdemod->audiobuf = NULL;
+	fdemod->step = 1.0;
+	fdemod->pos = 0.0;
+	fdemod->last = 0.0;
+	fdemod->rot[0] = 1.0;
+	fdemod->rot[1] = 0.0;
+	fdemod->drot[0] = 1.0;
+	fdemod->drot[1] = 0.0;
+	gst_iqfdemod_setup(fdemod);
 }
 
 GType gst_iqfdemod_get_type(void)
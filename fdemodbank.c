@@ -0,0 +1,546 @@
+/*
+ *	Frequency domain demodulator bank.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Many iqfdemod channels fed from one spectrum.
+ *	Every requested src_%d pad is a channel. The channels are set with
+ *	the "channels" property: a comma separated list with one
+ *	offset:mode[:length] entry per pad, e.g. "1500:3,-7000:4:128".
+ *	Without a length the output length comes from downstream, as with
+ *	iqfdemod, or else is the same as the input length.
+ *	With more than one thread the channels are spread over a thread
+ *	pool, each frame is pushed on all pads once every channel is done.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "gstiq.h"
+#include <string.h>
+
+static GstElementDetails iqfdemodbank_details = GST_ELEMENT_DETAILS(
+	"Frequency domain demodulator bank",
+	"Filter/Effect/Audio",
+	"Multiple frequency domain demodulators on one spectrum",
+	"agent (agent@local)"
+);
+
+enum {
+	ARG_0,
+	ARG_CHANNELS,
+	ARG_THREADS,
+};
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src_%d",
+	GST_PAD_SRC,
+	GST_PAD_REQUEST,
+	GST_STATIC_CAPS(
+		"audio/x-fft-float, "
+		"depth = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1, "
+		"length = (int) [ 1, MAX ], "
+		"endianness = (int) BYTE_ORDER "
+	)
+);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-fft-float, "
+		"depth = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1, "
+		"length = (int) [ 1, MAX ], "
+		"endianness = (int) BYTE_ORDER "
+	)
+);
+
+static GstElementClass *parent_class = NULL;
+
+/* Take offset, mode and length of channel 'ch' from the config string */
+static void gst_iqfdemodbank_configure(Gst_iqfdemodbank *bank,
+    struct fdemodbank_channel *ch)
+{
+	gchar **list, **fields;
+	int i, nr;
+
+	ch->foffset = 0;
+	ch->mode = FDEMOD_USB;
+	ch->length = 0;
+	ch->dirty = 1;
+	if (!bank->config)
+		return;
+	list = g_strsplit_set(bank->config, ", ", -1);
+	for (i = 0, nr = 0; list[i]; i++) {
+		if (!*list[i])
+			continue;
+		if (nr++ != ch->nr)
+			continue;
+		fields = g_strsplit(list[i], ":", 3);
+		if (fields[0])
+			ch->foffset = atoi(fields[0]);
+		if (fields[0] && fields[1])
+			ch->mode = atoi(fields[1]);
+		if (fields[0] && fields[1] && fields[2])
+			ch->length = atoi(fields[2]);
+		g_strfreev(fields);
+		break;
+	}
+	g_strfreev(list);
+}
+
+/* A channel being set up, caps are negotiated without the object lock */
+struct fdemodbank_setup {
+	struct fdemodbank_channel *ch;
+	GstPad *srcpad;
+	int length;
+	int rate;
+	gboolean hermitian;
+};
+
+/*
+ *	Work out the output format of the dirty channels and build their
+ *	tables. Downstream may fix the length and rate, otherwise a channel
+ *	keeps the bin width of the input.
+ *	Called and returns with the object lock held, but drops it while
+ *	talking to the peers: setting caps emits notify::caps and a handler
+ *	may well want the bank's properties.
+ */
+static void gst_iqfdemodbank_channels_setup(Gst_iqfdemodbank *bank)
+{
+	struct fdemodbank_setup *setup;
+	struct fdemodbank_channel *ch;
+	GstStructure *structure;
+	GstCaps *caps;
+	int i, j, n;
+
+	for (i = 0, n = 0; i < bank->nchannels; i++)
+		if (bank->channels[i]->dirty)
+			n++;
+	if (!n)
+		return;
+	setup = g_new0(struct fdemodbank_setup, n);
+	for (i = 0, n = 0; i < bank->nchannels; i++) {
+		ch = bank->channels[i];
+		if (!ch->dirty)
+			continue;
+		ch->dirty = 0;
+		setup[n].ch = ch;
+		setup[n].srcpad = gst_object_ref(ch->srcpad);
+		n++;
+	}
+	GST_OBJECT_UNLOCK(bank);
+
+	for (j = 0; j < n; j++) {
+		caps = gst_pad_get_allowed_caps(setup[j].srcpad);
+		if (caps && !gst_caps_is_empty(caps)) {
+			structure = gst_caps_get_structure(caps, 0);
+			gst_structure_get_int(structure, "length",
+			    &setup[j].length);
+			gst_structure_get_int(structure, "rate", &setup[j].rate);
+			gst_structure_get_boolean(structure, "hermitian",
+			    &setup[j].hermitian);
+		}
+		if (caps)
+			gst_caps_unref(caps);
+	}
+
+	GST_OBJECT_LOCK(bank);
+	for (j = 0; j < n; j++) {
+		/* The pad may have been released in the mean time */
+		for (i = 0; i < bank->nchannels; i++)
+			if (bank->channels[i] == setup[j].ch &&
+			    setup[j].ch->srcpad == setup[j].srcpad)
+				break;
+		if (i == bank->nchannels) {
+			setup[j].length = 0;
+			continue;
+		}
+		ch = setup[j].ch;
+		if (ch->length)
+			setup[j].length = ch->length;
+		if (!setup[j].length)
+			setup[j].length = bank->sinklength;
+		if (!setup[j].rate && bank->sinklength)
+			setup[j].rate = (gint64)bank->sinkrate *
+			    setup[j].length / bank->sinklength;
+		ch->rate = setup[j].rate;
+
+		fdemod_table_setup(&ch->table, ch->mode, ch->foffset,
+		    bank->sinklength, setup[j].length,
+		    bank->sinklength ?
+		    (double)bank->sinkrate / bank->sinklength : 0.0,
+		    setup[j].hermitian, FDEMOD_CW_BFO);
+		if (!ch->table.length)
+			setup[j].length = 0;
+	}
+	GST_OBJECT_UNLOCK(bank);
+
+	for (j = 0; j < n; j++) {
+		if (setup[j].length) {
+			caps = gst_caps_copy(
+			    gst_pad_get_pad_template_caps(setup[j].srcpad));
+			gst_structure_set(gst_caps_get_structure(caps, 0),
+			    "rate", G_TYPE_INT, setup[j].rate,
+			    "length", G_TYPE_INT, setup[j].length,
+			    NULL);
+			gst_pad_set_caps(setup[j].srcpad, caps);
+			gst_caps_unref(caps);
+		}
+		gst_object_unref(setup[j].srcpad);
+	}
+	g_free(setup);
+
+	GST_OBJECT_LOCK(bank);
+}
+
+static void gst_iqfdemodbank_work(gpointer data, gpointer user_data)
+{
+	struct fdemodbank_channel *ch = data;
+	Gst_iqfdemodbank *bank = user_data;
+
+	fdemod_table_process(&ch->table, ch->in,
+	    (float *)GST_BUFFER_DATA(ch->outbuf));
+
+	g_mutex_lock(bank->lock);
+	if (--bank->pending == 0)
+		g_cond_signal(bank->done);
+	g_mutex_unlock(bank->lock);
+}
+
+static GstFlowReturn gst_iqfdemodbank_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_iqfdemodbank *bank;
+	struct fdemodbank_channel *ch;
+	GstBuffer **outbufs;
+	GstPad **srcpads;
+	GstCaps *caps;
+	int i, n;
+
+	bank = GST_IQFDEMODBANK(gst_pad_get_parent(pad));
+	if (GST_BUFFER_SIZE(buf) < bank->sinklength * sizeof(float) * 2)
+		goto out;
+
+	GST_OBJECT_LOCK(bank);
+	gst_iqfdemodbank_channels_setup(bank);
+	n = bank->nchannels;
+	outbufs = g_new0(GstBuffer *, n);
+	srcpads = g_new0(GstPad *, n);
+	for (i = 0; i < n; i++) {
+		ch = bank->channels[i];
+		if (!ch->table.length)
+			continue;
+		ch->outbuf = gst_buffer_new_and_alloc(
+		    ch->table.length * sizeof(float) * 2);
+		ch->in = (float *)GST_BUFFER_DATA(buf);
+		outbufs[i] = ch->outbuf;
+		/* Keep the pad while pushing, it may be released */
+		srcpads[i] = gst_object_ref(ch->srcpad);
+	}
+
+	if (bank->threads > 1 && !bank->pool)
+		bank->pool = g_thread_pool_new(gst_iqfdemodbank_work, bank,
+		    bank->threads, TRUE, NULL);
+	if (bank->threads > 1 && bank->pool && n > 1) {
+		bank->pending = 1;
+		for (i = 0; i < n; i++) {
+			if (!outbufs[i])
+				continue;
+			g_mutex_lock(bank->lock);
+			bank->pending++;
+			g_mutex_unlock(bank->lock);
+			g_thread_pool_push(bank->pool, bank->channels[i], NULL);
+		}
+		g_mutex_lock(bank->lock);
+		bank->pending--;
+		while (bank->pending)
+			g_cond_wait(bank->done, bank->lock);
+		g_mutex_unlock(bank->lock);
+	} else {
+		for (i = 0; i < n; i++) {
+			ch = bank->channels[i];
+			if (outbufs[i])
+				fdemod_table_process(&ch->table, ch->in,
+				    (float *)GST_BUFFER_DATA(ch->outbuf));
+		}
+	}
+	for (i = 0; i < n; i++)
+		bank->channels[i]->outbuf = NULL;
+	GST_OBJECT_UNLOCK(bank);
+
+	for (i = 0; i < n; i++) {
+		if (!outbufs[i])
+			continue;
+		caps = gst_pad_get_caps(srcpads[i]);
+		gst_buffer_set_caps(outbufs[i], caps);
+		gst_caps_unref(caps);
+		GST_BUFFER_TIMESTAMP(outbufs[i]) = GST_BUFFER_TIMESTAMP(buf);
+		GST_BUFFER_OFFSET(outbufs[i]) = bank->offset;
+		gst_pad_push(srcpads[i], outbufs[i]);
+		gst_object_unref(srcpads[i]);
+	}
+	bank->offset++;
+	g_free(outbufs);
+	g_free(srcpads);
+out:
+	gst_buffer_unref(buf);
+	gst_object_unref(bank);
+	return GST_FLOW_OK;
+}
+
+static GstPad *gst_iqfdemodbank_request_new_pad(GstElement *element,
+    GstPadTemplate *templ, const gchar *rname)
+{
+	Gst_iqfdemodbank *bank;
+	struct fdemodbank_channel *ch, **channels;
+	gchar *name;
+	int i;
+
+	bank = GST_IQFDEMODBANK(element);
+
+	ch = malloc(sizeof(struct fdemodbank_channel));
+	if (!ch)
+		return NULL;
+	memset(ch, 0, sizeof(struct fdemodbank_channel));
+
+	GST_OBJECT_LOCK(bank);
+	channels = realloc(bank->channels,
+	    sizeof(struct fdemodbank_channel *) * (bank->nchannels + 1));
+	if (!channels) {
+		GST_OBJECT_UNLOCK(bank);
+		free(ch);
+		return NULL;
+	}
+	bank->channels = channels;
+	/* Lowest number not in use, pads may have been released */
+	for (ch->nr = 0, i = 0; i < bank->nchannels; i++) {
+		if (bank->channels[i]->nr == ch->nr) {
+			ch->nr++;
+			i = -1;
+		}
+	}
+	gst_iqfdemodbank_configure(bank, ch);
+	GST_OBJECT_UNLOCK(bank);
+
+	name = g_strdup_printf("src_%d", ch->nr);
+	ch->srcpad = gst_pad_new_from_template(templ, name);
+	g_free(name);
+	gst_pad_use_fixed_caps(ch->srcpad);
+	if (!gst_element_add_pad(element, ch->srcpad)) {
+		gst_object_unref(ch->srcpad);
+		free(ch);
+		return NULL;
+	}
+
+	GST_OBJECT_LOCK(bank);
+	bank->channels[bank->nchannels++] = ch;
+	GST_OBJECT_UNLOCK(bank);
+
+	return ch->srcpad;
+}
+
+static void gst_iqfdemodbank_release_pad(GstElement *element, GstPad *pad)
+{
+	Gst_iqfdemodbank *bank;
+	struct fdemodbank_channel *ch = NULL;
+	int i;
+
+	bank = GST_IQFDEMODBANK(element);
+
+	/* The chain holds the lock while the channels are processed */
+	GST_OBJECT_LOCK(bank);
+	for (i = 0; i < bank->nchannels; i++) {
+		if (bank->channels[i]->srcpad != pad)
+			continue;
+		ch = bank->channels[i];
+		memmove(bank->channels + i, bank->channels + i + 1,
+		    sizeof(struct fdemodbank_channel *) *
+		    (bank->nchannels - i - 1));
+		bank->nchannels--;
+		break;
+	}
+	GST_OBJECT_UNLOCK(bank);
+
+	if (ch) {
+		fdemod_table_free(&ch->table);
+		free(ch);
+	}
+	gst_element_remove_pad(element, pad);
+}
+
+static GstStateChangeReturn gst_iqfdemodbank_change_state(GstElement *element,
+    GstStateChange transition)
+{
+	return parent_class->change_state(element, transition);
+}
+
+static gboolean gst_iqfdemodbank_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_iqfdemodbank *bank;
+	GstStructure *structure;
+	gboolean ret = TRUE;
+	int length = 0, rate = 0;
+	int i;
+
+	bank = GST_IQFDEMODBANK(gst_pad_get_parent(pad));
+	structure = gst_caps_get_structure(caps, 0);
+
+	gst_structure_get_int(structure, "length", &length);
+	gst_structure_get_int(structure, "rate", &rate);
+	if (rate && length) {
+		GST_OBJECT_LOCK(bank);
+		bank->sinklength = length;
+		bank->sinkrate = rate;
+		for (i = 0; i < bank->nchannels; i++)
+			bank->channels[i]->dirty = 1;
+		GST_OBJECT_UNLOCK(bank);
+	} else {
+		ret = FALSE;
+	}
+
+	gst_object_unref(bank);
+	return ret;
+}
+
+static void gst_iqfdemodbank_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_iqfdemodbank *bank;
+	int i;
+
+	g_return_if_fail(GST_IS_IQFDEMODBANK(object));
+	bank = GST_IQFDEMODBANK(object);
+
+	switch(prop_id) {
+		case ARG_CHANNELS:
+			GST_OBJECT_LOCK(bank);
+			g_free(bank->config);
+			bank->config = g_strdup(g_value_get_string(value));
+			for (i = 0; i < bank->nchannels; i++)
+				gst_iqfdemodbank_configure(bank,
+				    bank->channels[i]);
+			GST_OBJECT_UNLOCK(bank);
+			break;
+		case ARG_THREADS:
+			GST_OBJECT_LOCK(bank);
+			bank->threads = g_value_get_int(value);
+			if (bank->pool)
+				g_thread_pool_free(bank->pool, FALSE, TRUE);
+			bank->pool = NULL;
+			GST_OBJECT_UNLOCK(bank);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_iqfdemodbank_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_iqfdemodbank *bank;
+
+	g_return_if_fail(GST_IS_IQFDEMODBANK(object));
+	bank = GST_IQFDEMODBANK(object);
+
+	switch(prop_id) {
+		case ARG_CHANNELS:
+			g_value_set_string(value, bank->config);
+			break;
+		case ARG_THREADS:
+			g_value_set_int(value, bank->threads);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static void gst_iqfdemodbank_class_init(Gst_iqfdemodbank_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gobject_class->set_property = gst_iqfdemodbank_set_property;
+	gobject_class->get_property = gst_iqfdemodbank_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_CHANNELS,
+	    g_param_spec_string("channels", "channels",
+	    "comma separated offset:mode[:length] per src pad", NULL,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_THREADS,
+	    g_param_spec_int("threads", "threads", "threads", 1, 64, 1,
+	    G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_iqfdemodbank_change_state;
+	gstelement_class->request_new_pad = gst_iqfdemodbank_request_new_pad;
+	gstelement_class->release_pad = gst_iqfdemodbank_release_pad;
+
+	gst_element_class_set_details(gstelement_class, &iqfdemodbank_details);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&src_template));
+}
+
+static void gst_iqfdemodbank_init(Gst_iqfdemodbank *bank)
+{
+	bank->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get (&sink_template), "sink");
+
+	gst_pad_set_chain_function (bank->sinkpad, gst_iqfdemodbank_chain);
+	gst_element_add_pad(GST_ELEMENT(bank), bank->sinkpad);
+
+	gst_pad_set_setcaps_function(bank->sinkpad, gst_iqfdemodbank_setcaps);
+	gst_pad_use_fixed_caps(bank->sinkpad);
+
+	bank->sinklength = 0;
+	bank->sinkrate = 0;
+	bank->config = NULL;
+	bank->channels = NULL;
+	bank->nchannels = 0;
+	bank->threads = 1;
+	bank->pool = NULL;
+	bank->lock = g_mutex_new();
+	bank->done = g_cond_new();
+	bank->pending = 0;
+	bank->offset = 0;
+}
+
+GType gst_iqfdemodbank_get_type(void)
+{
+	static GType iqfdemodbank_type = 0;
+
+	if (!iqfdemodbank_type) {
+		static const GTypeInfo iqfdemodbank_info = {
+			sizeof(Gst_iqfdemodbank_class),
+			NULL,
+			NULL,
+			(GClassInitFunc)gst_iqfdemodbank_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_iqfdemodbank),
+			0,
+			(GInstanceInitFunc)gst_iqfdemodbank_init,
+		};
+		iqfdemodbank_type = g_type_register_static(GST_TYPE_ELEMENT,
+		    "GstIQFDemBank", &iqfdemodbank_info, 0);
+	}
+	return iqfdemodbank_type;
+}
@@ -0,0 +1,158 @@
+/*
+ *	Shared FFT plans.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Every FFT element in a pipeline used to plan its own transform,
+ *	even when many of them use the same length. Plans are kept here
+ *	instead, reference counted and keyed on the transform parameters
+ *	and on the alignment of the arrays they were made for.
+ *	Users execute them on their own fftwf_malloc()ed buffers with the
+ *	new-array execute functions (fftwf_execute_dft() and friends).
+ *
+ *	Planning is done with FFTW_MEASURE on the caller's arrays, their
+ *	contents are destroyed when a new plan has to be made.
+ *	The fftw planner is not thread safe, so all planning is done with
+ *	the registry locked.
+ */
+
+#include <fftw3.h>
+#include "gstiq.h"
+
+struct iqfftplan {
+	struct iqfftplan *next;
+
+	int kind;
+	int length;
+	int howmany;
+	int threads;
+	int inplace;
+	int ialign;
+	int oalign;
+
+	int refs;
+	fftwf_plan plan;
+};
+
+static struct iqfftplan *iqfftplans = NULL;
+static int iqfftplan_threads = 0;
+G_LOCK_DEFINE_STATIC(iqfftplans);
+
+static fftwf_plan iqfftplan_new(int kind, int n, int howmany, void *in,
+    void *out)
+{
+	if (howmany == 1) switch (kind) {
+		case FFTPLAN_FORWARD:
+			return fftwf_plan_dft_1d(n, in, out,
+			    FFTW_FORWARD, FFTW_MEASURE);
+		case FFTPLAN_BACKWARD:
+			return fftwf_plan_dft_1d(n, in, out,
+			    FFTW_BACKWARD, FFTW_MEASURE);
+		case FFTPLAN_R2C:
+			return fftwf_plan_dft_r2c_1d(n, in, out, FFTW_MEASURE);
+		case FFTPLAN_C2R:
+			return fftwf_plan_dft_c2r_1d(n, in, out, FFTW_MEASURE);
+		default:
+			return NULL;
+	}
+
+	/* Batches keep a stride of 'n' elements, also for the half spectra */
+	switch (kind) {
+		case FFTPLAN_FORWARD:
+			return fftwf_plan_many_dft(1, &n, howmany,
+			    in, NULL, 1, n, out, NULL, 1, n,
+			    FFTW_FORWARD, FFTW_MEASURE);
+		case FFTPLAN_BACKWARD:
+			return fftwf_plan_many_dft(1, &n, howmany,
+			    in, NULL, 1, n, out, NULL, 1, n,
+			    FFTW_BACKWARD, FFTW_MEASURE);
+		case FFTPLAN_R2C:
+			return fftwf_plan_many_dft_r2c(1, &n, howmany,
+			    in, NULL, 1, n, out, NULL, 1, n, FFTW_MEASURE);
+		case FFTPLAN_C2R:
+			return fftwf_plan_many_dft_c2r(1, &n, howmany,
+			    in, NULL, 1, n, out, NULL, 1, n, FFTW_MEASURE);
+		default:
+			return NULL;
+	}
+}
+
+fftwf_plan iqfftplan_get(int kind, int length, int howmany, int threads,
+    void *in, void *out)
+{
+	struct iqfftplan *entry;
+	int inplace = (in == out);
+	int ialign = fftwf_alignment_of(in);
+	int oalign = fftwf_alignment_of(out);
+	fftwf_plan plan = NULL;
+
+	G_LOCK(iqfftplans);
+	for (entry = iqfftplans; entry; entry = entry->next) {
+		if (entry->kind == kind &&
+		    entry->length == length &&
+		    entry->howmany == howmany &&
+		    entry->threads == threads &&
+		    entry->inplace == inplace &&
+		    entry->ialign == ialign &&
+		    entry->oalign == oalign) {
+			entry->refs++;
+			plan = entry->plan;
+			goto out;
+		}
+	}
+
+	entry = malloc(sizeof(struct iqfftplan));
+	if (!entry)
+		goto out;
+	if (!iqfftplan_threads)
+		iqfftplan_threads = fftwf_init_threads();
+	fftwf_plan_with_nthreads(iqfftplan_threads ? threads : 1);
+	plan = iqfftplan_new(kind, length, howmany, in, out);
+	fftwf_plan_with_nthreads(1);
+	if (!plan) {
+		free(entry);
+		goto out;
+	}
+	entry->kind = kind;
+	entry->length = length;
+	entry->howmany = howmany;
+	entry->threads = threads;
+	entry->inplace = inplace;
+	entry->ialign = ialign;
+	entry->oalign = oalign;
+	entry->refs = 1;
+	entry->plan = plan;
+	entry->next = iqfftplans;
+	iqfftplans = entry;
+out:
+	G_UNLOCK(iqfftplans);
+	return plan;
+}
+
+void iqfftplan_put(fftwf_plan plan)
+{
+	struct iqfftplan **entryp, *entry;
+
+	if (!plan)
+		return;
+	G_LOCK(iqfftplans);
+	for (entryp = &iqfftplans; *entryp; entryp = &(*entryp)->next) {
+		entry = *entryp;
+		if (entry->plan != plan)
+			continue;
+		if (--entry->refs == 0) {
+			*entryp = entry->next;
+			fftwf_destroy_plan(entry->plan);
+			free(entry);
+		}
+		break;
+	}
+	G_UNLOCK(iqfftplans);
+}
@@ -22,7 +22,9 @@ static GstElementDetails iqfmdem_details = GST_ELEMENT_DETAILS(
 
 enum {
 	ARG_0,
-	ARG_DEVIATION
+	ARG_DEVIATION,
+	ARG_AUDIORATE,
+	ARG_DEEMPHASIS,
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
@@ -57,23 +59,89 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
 
 static GstElementClass *parent_class = NULL;
 
+/*
+ *	With an audio rate below the input rate the discriminator output
+ *	is low-passed by a single pole at half the audio rate and then
+ *	averaged over each output period. The average of the phase steps
+ *	is the phase change over the period, so this integrate-and-dump is
+ *	still an exact discriminator at the lower rate. Audio rates that
+ *	do not divide the input rate are fine, the periods alternate in
+ *	length. De-emphasis is a single pole at the output rate.
+ */
+static void gst_iqfmdem_coefficients(Gst_iqfmdem *fmdem)
+{
+	if (!fmdem->rate)
+		return;
+	fmdem->outrate = fmdem->audiorate && fmdem->audiorate < fmdem->rate ?
+	    fmdem->audiorate : fmdem->rate;
+	fmdem->normal = (float)fmdem->rate / (fmdem->deviation * M_PI * 2);
+	fmdem->avrglen = fmdem->outrate / 10;
+	if (fmdem->avrglen < 1.0)
+		fmdem->avrglen = 1.0;
+	if (fmdem->outrate < fmdem->rate)
+		fmdem->lpalpha = 1.0 - exp(-M_PI * fmdem->outrate / fmdem->rate);
+	else
+		fmdem->lpalpha = 1.0;
+	if (fmdem->deemphasis > 0.0)
+		fmdem->dealpha = 1.0 - exp(-1.0 /
+		    (fmdem->deemphasis * 1e-6 * fmdem->outrate));
+	else
+		fmdem->dealpha = 1.0;
+}
+
+static gboolean gst_iqfmdem_setsrccaps(Gst_iqfmdem *fmdem)
+{
+	GstCaps *newcaps;
+	GstStructure *structure;
+	gboolean ret;
+
+	newcaps = gst_caps_copy(gst_pad_get_pad_template_caps(fmdem->srcpad));
+	structure = gst_caps_get_structure(newcaps, 0);
+	gst_structure_set(structure, "rate", G_TYPE_INT, fmdem->outrate, NULL);
+	gst_structure_set(structure, "buffer-frames", G_TYPE_INT,
+	    (int)((gint64)fmdem->bufferframes * fmdem->outrate / fmdem->rate),
+	    NULL);
+
+	gst_pad_use_fixed_caps(fmdem->srcpad);
+	ret = gst_pad_set_caps(fmdem->srcpad, newcaps);
+	gst_caps_unref(newcaps);
+	return ret;
+}
+
 static GstFlowReturn gst_iqfmdem_chain(GstPad *pad, GstBuffer *buf)
 {
 	Gst_iqfmdem *fmdem;
 	GstBuffer *outbuf;
 	GstCaps *caps;
-	gfloat *iqbuf, *bufout, angle, dev;
-	int i;
+	gfloat *iqbuf, *bufout, angle, dev, y;
+	int i, n, o;
 
 	fmdem = GST_IQFMDEM(gst_pad_get_parent(pad));
 
-	outbuf = gst_buffer_new_and_alloc(GST_BUFFER_SIZE(buf)/2);
+	GST_OBJECT_LOCK(fmdem);
+	if (fmdem->renegotiate) {
+		fmdem->renegotiate = 0;
+		gst_iqfmdem_coefficients(fmdem);
+		GST_OBJECT_UNLOCK(fmdem);
+		gst_iqfmdem_setsrccaps(fmdem);
+	} else
+		GST_OBJECT_UNLOCK(fmdem);
+
+	if (!fmdem->outrate) {
+		gst_buffer_unref(buf);
+		gst_object_unref(fmdem);
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	n = GST_BUFFER_SIZE(buf) / (sizeof(gfloat) * 2);
+	outbuf = gst_buffer_new_and_alloc(sizeof(gfloat) *
+	    ((gint64)n * fmdem->outrate / fmdem->rate + 1));
 	GST_BUFFER_OFFSET(outbuf) = fmdem->offset;
 	GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
 
 	iqbuf = (gfloat *)GST_BUFFER_DATA(buf);
 	bufout = (gfloat *)GST_BUFFER_DATA(outbuf);
-	for (i = 0; i < GST_BUFFER_SIZE(outbuf)/sizeof(gfloat); i ++) {
+	for (i = 0, o = 0; i < n; i++) {
 		angle = iqbuf[i*2 + 1];
 		dev = angle - fmdem->prevangle;
 		fmdem->prevangle = angle;
@@ -81,14 +149,26 @@ static GstFlowReturn gst_iqfmdem_chain(GstPad *pad, GstBuffer *buf)
 			dev -= 2 * M_PI;
 		if (dev < -M_PI)
 			dev += 2 * M_PI;
-		bufout[i] = dev * fmdem->normal;
-		fmdem->avrg += (bufout[i] - fmdem->avrg) / fmdem->avrglen;
-		bufout[i] -= fmdem->avrg;
-		fmdem->filter += (bufout[i] - fmdem->filter)/(10);
-		bufout[i] = fmdem->filter;
-		
+		fmdem->lp += (dev - fmdem->lp) * fmdem->lpalpha;
+		fmdem->sum += fmdem->lp;
+		fmdem->count++;
+
+		/* Next output sample due? */
+		fmdem->phase += fmdem->outrate;
+		if (fmdem->phase < fmdem->rate)
+			continue;
+		fmdem->phase -= fmdem->rate;
+
+		y = fmdem->sum * fmdem->normal / fmdem->count;
+		fmdem->sum = 0.0;
+		fmdem->count = 0;
+		fmdem->avrg += (y - fmdem->avrg) / fmdem->avrglen;
+		y -= fmdem->avrg;
+		fmdem->filter += (y - fmdem->filter) * fmdem->dealpha;
+		bufout[o++] = fmdem->filter;
 	}
-	fmdem->offset += i;
+	GST_BUFFER_SIZE(outbuf) = o * sizeof(gfloat);
+	fmdem->offset += o;
 
 	caps = gst_pad_get_caps(fmdem->srcpad);
 	gst_buffer_set_caps(outbuf, caps);
@@ -107,14 +187,23 @@ static void gst_iqfmdem_set_property(GObject *object, guint prop_id,
 	g_return_if_fail(GST_IS_IQFMDEM(object));
 	fmdem = GST_IQFMDEM(object);
 
+	GST_OBJECT_LOCK(fmdem);
 	switch(prop_id) {
 		case ARG_DEVIATION:
 			fmdem->deviation = g_value_get_float(value);
-			fmdem->normal = fmdem->deviation / (float)fmdem->rate;
+			break;
+		case ARG_AUDIORATE:
+			fmdem->audiorate = g_value_get_int(value);
+			break;
+		case ARG_DEEMPHASIS:
+			fmdem->deemphasis = g_value_get_float(value);
 			break;
 		default:
 			break;
 	}
+	/* The chain picks up the new values, and renegotiates if needed */
+	fmdem->renegotiate = fmdem->rate != 0;
+	GST_OBJECT_UNLOCK(fmdem);
 }
 
 static void gst_iqfmdem_get_property(GObject *object, guint prop_id,
@@ -129,6 +218,12 @@ static void gst_iqfmdem_get_property(GObject *object, guint prop_id,
 		case ARG_DEVIATION:
 			g_value_set_float(value, fmdem->deviation);
 			break;
+		case ARG_AUDIORATE:
+			g_value_set_int(value, fmdem->audiorate);
+			break;
+		case ARG_DEEMPHASIS:
+			g_value_set_float(value, fmdem->deemphasis);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -145,29 +240,51 @@ static gboolean gst_iqfmdem_setcaps(GstPad *pad, GstCaps *caps)
 {
 	GstStructure *structure;
 	Gst_iqfmdem *fmdem;
-	GstCaps *newcaps;
-	GstPad *other;
-	gint bufferframes;
+	gboolean ret;
+	gint rate, bufferframes = 0;
 
 	fmdem = GST_IQFMDEM(gst_pad_get_parent(pad));
 	structure = gst_caps_get_structure(caps, 0);
-	gst_structure_get_int(structure, "rate", &fmdem->rate);
+	gst_structure_get_int(structure, "rate", &rate);
 	gst_structure_get_int(structure, "buffer-frames", &bufferframes);
 
-	fmdem->normal = (float)fmdem->rate / (fmdem->deviation * M_PI * 2);
-	fmdem->avrglen = fmdem->rate / 10;
-
-	other = pad == fmdem->srcpad ? fmdem->sinkpad : fmdem->srcpad;
-	newcaps = gst_pad_get_caps(other);
-	newcaps = gst_caps_make_writable(newcaps);
-	structure = gst_caps_get_structure(newcaps, 0);
-	gst_structure_set(structure, "rate", G_TYPE_INT, fmdem->rate, NULL);
-	gst_structure_set(structure, "buffer-frames", G_TYPE_INT, bufferframes,
-	    NULL);
+	/*
+	 *	Downstream can only pick the input rate when there is no
+	 *	decimation, otherwise it has to take the output rate. That
+	 *	is the audio rate, or the input rate when that is lower.
+	 */
+	if (pad == fmdem->srcpad && fmdem->audiorate) {
+		GST_OBJECT_LOCK(fmdem);
+		ret = rate == (fmdem->rate ? fmdem->outrate : fmdem->audiorate);
+		GST_OBJECT_UNLOCK(fmdem);
+		gst_object_unref(fmdem);
+		return ret;
+	}
 
-	gst_pad_use_fixed_caps(other);
+	GST_OBJECT_LOCK(fmdem);
+	fmdem->rate = rate;
+	fmdem->bufferframes = bufferframes;
+	fmdem->renegotiate = 0;
+	gst_iqfmdem_coefficients(fmdem);
+	GST_OBJECT_UNLOCK(fmdem);
+
+	if (pad == fmdem->sinkpad) {
+		ret = gst_iqfmdem_setsrccaps(fmdem);
+	} else {
+		GstCaps *newcaps;
+
+		newcaps = gst_caps_copy(
+		    gst_pad_get_pad_template_caps(fmdem->sinkpad));
+		structure = gst_caps_get_structure(newcaps, 0);
+		gst_structure_set(structure, "rate", G_TYPE_INT, rate, NULL);
+		gst_structure_set(structure, "buffer-frames", G_TYPE_INT,
+		    bufferframes, NULL);
+		gst_pad_use_fixed_caps(fmdem->sinkpad);
+		ret = gst_pad_set_caps(fmdem->sinkpad, newcaps);
+		gst_caps_unref(newcaps);
+	}
 	gst_object_unref(fmdem);
-	return gst_pad_set_caps(other, newcaps);
+	return ret;
 }
 
 static void gst_iqfmdem_class_init(Gst_iqfmdem_class *klass)
@@ -186,6 +303,14 @@ static void gst_iqfmdem_class_init(Gst_iqfmdem_class *klass)
 	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_DEVIATION,
 	    g_param_spec_float("deviation", "deviation", "deviation",
 	    1.0, G_MAXFLOAT, 1500.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_AUDIORATE,
+	    g_param_spec_int("audio-rate", "audio-rate",
+	    "output sample rate, 0 for the input rate",
+	    0, G_MAXINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_DEEMPHASIS,
+	    g_param_spec_float("deemphasis", "deemphasis",
+	    "de-emphasis time constant in us (50 or 75), 0 for none",
+	    0.0, G_MAXFLOAT, 0.0, G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_iqfmdem_change_state;
 
@@ -212,8 +337,18 @@ static void gst_iqfmdem_init(Gst_iqfmdem *fmdem)
 	gst_pad_set_setcaps_function(fmdem->srcpad, gst_iqfmdem_setcaps);
 	gst_pad_set_setcaps_function(fmdem->sinkpad, gst_iqfmdem_setcaps);
 
+	fmdem->rate = 0;
+	fmdem->outrate = 0;
+	fmdem->bufferframes = 0;
 	fmdem->deviation = 1500.0;
+	fmdem->audiorate = 0;
+	fmdem->deemphasis = 0.0;
+	fmdem->renegotiate = 0;
 	fmdem->avrg = 0.0;
+	fmdem->lp = 0.0;
+	fmdem->sum = 0.0;
+	fmdem->count = 0;
+	fmdem->phase = 0;
 	fmdem->filter = 0.0;
 	fmdem->offset = 0;
 }
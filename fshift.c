@@ -22,7 +22,9 @@ static GstElementDetails iqfshift_details = GST_ELEMENT_DETAILS(
 
 enum {
 	ARG_0,
-	ARG_SHIFT
+	ARG_SHIFT,
+	ARG_CONTROL,
+	ARG_CONTROLSCALE,
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
@@ -59,10 +61,20 @@ static GstFlowReturn gst_iqfshift_chain(GstPad *pad, GstBuffer *buf)
 	GstBuffer *outbuf;
 	GstCaps *caps;
 	gfloat *iqbuf, *iqbufout, ival, qval, cosine, sine;
+	float value;
 	int i;
 
 	fshift = GST_IQFSHIFT(gst_pad_get_parent(pad));
 
+	GST_OBJECT_LOCK(fshift);
+	if (fshift->control && iqcontrol_read(fshift->control, &value,
+	    &fshift->controlseq)) {
+		fshift->shift = value * fshift->controlscale;
+		fshift->step =
+		    fshift->shift * 2 * M_PI / (float)fshift->rate;
+	}
+	GST_OBJECT_UNLOCK(fshift);
+
 	caps = gst_pad_get_caps(fshift->srcpad);
 	if (fshift->shift != 0.0) {
 		if (!gst_buffer_is_writable(buf)) {
@@ -115,6 +127,19 @@ static void gst_iqfshift_set_property(GObject *object, guint prop_id,
 			fshift->step =
 			    fshift->shift * 2 * M_PI / (float)fshift->rate;
 			break;
+		case ARG_CONTROL:
+			GST_OBJECT_LOCK(fshift);
+			iqcontrol_put(fshift->control);
+			g_free(fshift->controlname);
+			fshift->controlname =
+			    g_strdup(g_value_get_string(value));
+			fshift->control = iqcontrol_get(fshift->controlname);
+			fshift->controlseq = 0;
+			GST_OBJECT_UNLOCK(fshift);
+			break;
+		case ARG_CONTROLSCALE:
+			fshift->controlscale = g_value_get_float(value);
+			break;
 		default:
 			break;
 	}
@@ -132,6 +157,12 @@ static void gst_iqfshift_get_property(GObject *object, guint prop_id,
 		case ARG_SHIFT:
 			g_value_set_float(value, fshift->shift);
 			break;
+		case ARG_CONTROL:
+			g_value_set_string(value, fshift->controlname);
+			break;
+		case ARG_CONTROLSCALE:
+			g_value_set_float(value, fshift->controlscale);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -181,6 +212,15 @@ static void gst_iqfshift_class_init(Gst_iqfshift_class *klass)
 
 	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_SHIFT,
 	    g_param_spec_float("shift", "shift", "shift", -G_MAXFLOAT, G_MAXFLOAT, 0.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_CONTROL,
+	    g_param_spec_string("control", "control",
+	    "name of a control value to take the shift from", NULL,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass),
+	    ARG_CONTROLSCALE,
+	    g_param_spec_float("control-scale", "control-scale",
+	    "shift is the control value times this",
+	    -G_MAXFLOAT, G_MAXFLOAT, 1.0, G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_iqfshift_change_state;
 
@@ -209,6 +249,10 @@ static void gst_iqfshift_init(Gst_iqfshift *fshift)
 
 	fshift->shift = 0.0;
 	fshift->angle = 0.0;
+	fshift->controlname = NULL;
+	fshift->control = NULL;
+	fshift->controlseq = 0;
+	fshift->controlscale = 1.0;
 }
 
 GType gst_iqfshift_get_type(void)
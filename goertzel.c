@@ -0,0 +1,412 @@
+/*
+ *	Goertzel tone detector.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Measures the power of a small set of frequencies over blocks of
+ *	'blocksize' samples, for tone detection or beacon monitoring where
+ *	a full FFT would be wasted.
+ *	The output holds one float per tone per block: the squared amplitude
+ *	of that tone. All blocks completed by an input buffer go out in a
+ *	single output buffer.
+ *	Complex input can tell positive and negative frequencies apart.
+ */
+
+#include <math.h>
+#include "gstiq.h"
+#include <string.h>
+
+static GstElementDetails iqgoertzel_details = GST_ELEMENT_DETAILS(
+	"Goertzel tone detector",
+	"Filter/Analyzer/Audio",
+	"Measures the power of a set of tones",
+	"agent (agent@local)"
+);
+
+enum {
+	ARG_0,
+	ARG_FREQUENCIES,
+	ARG_BLOCKSIZE,
+};
+
+/* Property changes left for the streaming thread */
+enum {
+	GOERTZEL_SETUP = 1,
+	GOERTZEL_RESET = 2,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-complex-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1; "
+
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"application/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"channels = (int) [ 1, MAX ]"
+	)
+);
+
+static GstElementClass *parent_class = NULL;
+
+/* Start a new block, of the current 'blocksize' */
+static void gst_iqgoertzel_reset(Gst_iqgoertzel *goertzel)
+{
+	GST_OBJECT_LOCK(goertzel);
+	goertzel->size = goertzel->blocksize;
+	GST_OBJECT_UNLOCK(goertzel);
+	memset(goertzel->s1r, 0, sizeof(float) * goertzel->tones * 4);
+	goertzel->count = 0;
+}
+
+static int gst_iqgoertzel_setup(Gst_iqgoertzel *goertzel)
+{
+	gchar **list;
+	int i, tones;
+
+	free(goertzel->coeff);
+	goertzel->coeff = NULL;
+	goertzel->tones = 0;
+	if (!goertzel->rate)
+		return -1;
+
+	GST_OBJECT_LOCK(goertzel);
+	list = goertzel->frequencies ?
+	    g_strsplit_set(goertzel->frequencies, ", ", -1) : NULL;
+	GST_OBJECT_UNLOCK(goertzel);
+	if (!list)
+		return -1;
+	for (i = 0, tones = 0; list[i]; i++)
+		if (*list[i])
+			tones++;
+	if (!tones)
+		goto out;
+
+	/* coeff, cosw, sinw and four state arrays, tone index fastest */
+	goertzel->coeff = malloc(sizeof(float) * tones * 7);
+	if (!goertzel->coeff)
+		goto out;
+	goertzel->cosw = goertzel->coeff + tones;
+	goertzel->sinw = goertzel->cosw + tones;
+	goertzel->s1r = goertzel->sinw + tones;
+	goertzel->s1i = goertzel->s1r + tones;
+	goertzel->s2r = goertzel->s1i + tones;
+	goertzel->s2i = goertzel->s2r + tones;
+	for (i = 0, tones = 0; list[i]; i++) {
+		float w;
+
+		if (!*list[i])
+			continue;
+		w = 2 * M_PI * g_ascii_strtod(list[i], NULL) / goertzel->rate;
+		goertzel->cosw[tones] = cos(w);
+		goertzel->sinw[tones] = sin(w);
+		goertzel->coeff[tones] = 2 * goertzel->cosw[tones];
+		tones++;
+	}
+	goertzel->tones = tones;
+	gst_iqgoertzel_reset(goertzel);
+out:
+	g_strfreev(list);
+	return goertzel->tones ? 0 : -1;
+}
+
+static gboolean gst_iqgoertzel_setsrccaps(Gst_iqgoertzel *goertzel)
+{
+	GstCaps *newcaps;
+	GstStructure *structure;
+	gboolean ret;
+
+	newcaps = gst_caps_copy(
+	    gst_pad_get_pad_template_caps(goertzel->srcpad));
+	structure = gst_caps_get_structure(newcaps, 0);
+	gst_structure_set(structure, "channels", G_TYPE_INT,
+	    goertzel->tones ? goertzel->tones : 1, NULL);
+	gst_pad_use_fixed_caps(goertzel->srcpad);
+	ret = gst_pad_set_caps(goertzel->srcpad, newcaps);
+	gst_caps_unref(newcaps);
+	return ret;
+}
+
+static GstFlowReturn gst_iqgoertzel_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_iqgoertzel *goertzel;
+	GstBuffer *outbuf = NULL;
+	GstCaps *caps;
+	float *in, *out = NULL;
+	float *coeff, *s1r, *s1i, *s2r, *s2i;
+	float xr, xi, s0, scale;
+	int tones, samples, blocks, step;
+	int i, t, j, reconfigure;
+
+	goertzel = GST_IQGOERTZEL(gst_pad_get_parent(pad));
+
+	/* New tones or block size take effect between two buffers */
+	GST_OBJECT_LOCK(goertzel);
+	reconfigure = goertzel->reconfigure;
+	goertzel->reconfigure = 0;
+	GST_OBJECT_UNLOCK(goertzel);
+	if (reconfigure & GOERTZEL_SETUP) {
+		gst_iqgoertzel_setup(goertzel);
+		if (goertzel->rate)
+			gst_iqgoertzel_setsrccaps(goertzel);
+	} else if ((reconfigure & GOERTZEL_RESET) && goertzel->tones) {
+		gst_iqgoertzel_reset(goertzel);
+	}
+
+	tones = goertzel->tones;
+	if (!tones || goertzel->size < 1)
+		goto out;
+
+	step = goertzel->complex ? 2 : 1;
+	in = (float *)GST_BUFFER_DATA(buf);
+	samples = GST_BUFFER_SIZE(buf) / sizeof(float) / step;
+	blocks = (goertzel->count + samples) / goertzel->size;
+	if (blocks) {
+		outbuf = gst_buffer_new_and_alloc(
+		    blocks * tones * sizeof(float));
+		out = (float *)GST_BUFFER_DATA(outbuf);
+		GST_BUFFER_OFFSET(outbuf) = goertzel->offset;
+		goertzel->offset += blocks;
+		GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
+		if (GST_BUFFER_TIMESTAMP_IS_VALID(buf))
+			GST_BUFFER_TIMESTAMP(outbuf) +=
+			    gst_util_uint64_scale_int(
+			    goertzel->size - goertzel->count,
+			    GST_SECOND, goertzel->rate);
+	}
+
+	coeff = goertzel->coeff;
+	s1r = goertzel->s1r;
+	s1i = goertzel->s1i;
+	s2r = goertzel->s2r;
+	s2i = goertzel->s2i;
+	scale = 1.0 / ((float)goertzel->size * goertzel->size);
+	if (!goertzel->complex)
+		scale *= 4.0;
+	for (i = 0; i < samples; i++) {
+		xr = in[i * step];
+		/* Independent per tone, the inner loops vectorize */
+		for (t = 0; t < tones; t++) {
+			s0 = xr + coeff[t] * s1r[t] - s2r[t];
+			s2r[t] = s1r[t];
+			s1r[t] = s0;
+		}
+		if (goertzel->complex) {
+			xi = in[i * 2 + 1];
+			for (t = 0; t < tones; t++) {
+				s0 = xi + coeff[t] * s1i[t] - s2i[t];
+				s2i[t] = s1i[t];
+				s1i[t] = s0;
+			}
+		}
+		if (++goertzel->count < goertzel->size)
+			continue;
+
+		/* |X|^2 = |e^jw * s1 - s2|^2 */
+		for (t = 0; t < tones; t++) {
+			float yr, yi;
+
+			yr = goertzel->cosw[t] * s1r[t] -
+			    goertzel->sinw[t] * s1i[t] - s2r[t];
+			yi = goertzel->sinw[t] * s1r[t] +
+			    goertzel->cosw[t] * s1i[t] - s2i[t];
+			out[t] = (yr * yr + yi * yi) * scale;
+		}
+		out += tones;
+		for (j = 0; j < tones * 4; j++)
+			s1r[j] = 0.0;
+		goertzel->count = 0;
+	}
+
+	if (outbuf) {
+		caps = gst_pad_get_caps(goertzel->srcpad);
+		gst_buffer_set_caps(outbuf, caps);
+		gst_caps_unref(caps);
+		gst_pad_push(goertzel->srcpad, outbuf);
+	}
+out:
+	gst_buffer_unref(buf);
+	gst_object_unref(goertzel);
+	return GST_FLOW_OK;
+}
+
+static void gst_iqgoertzel_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_iqgoertzel *goertzel;
+
+	g_return_if_fail(GST_IS_IQGOERTZEL(object));
+	goertzel = GST_IQGOERTZEL(object);
+
+	switch(prop_id) {
+		case ARG_FREQUENCIES:
+			GST_OBJECT_LOCK(goertzel);
+			g_free(goertzel->frequencies);
+			goertzel->frequencies =
+			    g_strdup(g_value_get_string(value));
+			goertzel->reconfigure |= GOERTZEL_SETUP;
+			GST_OBJECT_UNLOCK(goertzel);
+			break;
+		case ARG_BLOCKSIZE:
+			GST_OBJECT_LOCK(goertzel);
+			goertzel->blocksize = g_value_get_int(value);
+			goertzel->reconfigure |= GOERTZEL_RESET;
+			GST_OBJECT_UNLOCK(goertzel);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_iqgoertzel_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_iqgoertzel *goertzel;
+
+	g_return_if_fail(GST_IS_IQGOERTZEL(object));
+	goertzel = GST_IQGOERTZEL(object);
+
+	switch(prop_id) {
+		case ARG_FREQUENCIES:
+			GST_OBJECT_LOCK(goertzel);
+			g_value_set_string(value, goertzel->frequencies);
+			GST_OBJECT_UNLOCK(goertzel);
+			break;
+		case ARG_BLOCKSIZE:
+			g_value_set_int(value, goertzel->blocksize);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static GstStateChangeReturn gst_iqgoertzel_change_state(GstElement *element,
+    GstStateChange transition)
+{
+	return parent_class->change_state(element, transition);
+}
+
+static gboolean gst_iqgoertzel_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_iqgoertzel *goertzel;
+	GstStructure *structure;
+	gboolean ret;
+
+	goertzel = GST_IQGOERTZEL(gst_pad_get_parent(pad));
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_get_int(structure, "rate", &goertzel->rate);
+	goertzel->complex = !strcmp(gst_structure_get_name(structure),
+	    "audio/x-complex-float");
+
+	gst_iqgoertzel_setup(goertzel);
+	ret = gst_iqgoertzel_setsrccaps(goertzel);
+	gst_object_unref(goertzel);
+	return ret;
+}
+
+static void gst_iqgoertzel_class_init(Gst_iqgoertzel_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gobject_class->set_property = gst_iqgoertzel_set_property;
+	gobject_class->get_property = gst_iqgoertzel_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_FREQUENCIES,
+	    g_param_spec_string("frequencies", "frequencies",
+	    "comma separated list of frequencies in Hz", NULL,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_BLOCKSIZE,
+	    g_param_spec_int("blocksize", "blocksize", "blocksize",
+	    1, G_MAXINT, 1024, G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_iqgoertzel_change_state;
+
+	gst_element_class_set_details(gstelement_class, &iqgoertzel_details);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&src_template));
+}
+
+static void gst_iqgoertzel_init(Gst_iqgoertzel *goertzel)
+{
+	goertzel->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&sink_template), "sink");
+
+	gst_pad_set_chain_function(goertzel->sinkpad, gst_iqgoertzel_chain);
+	gst_element_add_pad(GST_ELEMENT(goertzel), goertzel->sinkpad);
+
+	goertzel->srcpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&src_template), "src");
+	gst_element_add_pad(GST_ELEMENT(goertzel), goertzel->srcpad);
+
+	gst_pad_set_setcaps_function(goertzel->sinkpad, gst_iqgoertzel_setcaps);
+
+	goertzel->rate = 0;
+	goertzel->complex = 1;
+	goertzel->blocksize = 1024;
+	goertzel->size = 1024;
+	goertzel->reconfigure = 0;
+	goertzel->count = 0;
+	goertzel->frequencies = NULL;
+	goertzel->tones = 0;
+	goertzel->coeff = NULL;
+	goertzel->offset = 0;
+}
+
+GType gst_iqgoertzel_get_type(void)
+{
+	static GType iqgoertzel_type = 0;
+
+	if (!iqgoertzel_type) {
+		static const GTypeInfo iqgoertzel_info = {
+			sizeof(Gst_iqgoertzel_class),
+			NULL,
+			NULL,
+			(GClassInitFunc)gst_iqgoertzel_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_iqgoertzel),
+			0,
+			(GInstanceInitFunc)gst_iqgoertzel_init,
+		};
+		iqgoertzel_type = g_type_register_static(GST_TYPE_ELEMENT,
+		    "GstIQGoertzel", &iqgoertzel_info, 0);
+	}
+	return iqgoertzel_type;
+}
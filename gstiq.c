@@ -28,6 +28,9 @@ static gboolean plugin_init (GstPlugin *plugin)
 	if (!gst_element_register(plugin, "iqfmdem", GST_RANK_NONE,
 	    GST_TYPE_IQFMDEM))
 		return FALSE;
+	if (!gst_element_register(plugin, "iqwfmstereo", GST_RANK_NONE,
+	    GST_TYPE_IQWFMSTEREO))
+		return FALSE;
 	if (!gst_element_register(plugin, "firblock", GST_RANK_NONE,
 	    GST_TYPE_FIRBLOCK))
 	    	return FALSE;
@@ -43,15 +46,30 @@ static gboolean plugin_init (GstPlugin *plugin)
 	if (!gst_element_register(plugin, "iqfdemod", GST_RANK_NONE,
 	    GST_TYPE_IQFDEMOD))
 		return FALSE;
+	if (!gst_element_register(plugin, "iqfdemodbank", GST_RANK_NONE,
+	    GST_TYPE_IQFDEMODBANK))
+		return FALSE;
+	if (!gst_element_register(plugin, "iqgoertzel", GST_RANK_NONE,
+	    GST_TYPE_IQGOERTZEL))
+		return FALSE;
 	if (!gst_element_register(plugin, "waterfall", GST_RANK_NONE,
 	    GST_TYPE_WATERFALL))
 		return FALSE;
+	if (!gst_element_register(plugin, "spectrogramsink", GST_RANK_NONE,
+	    GST_TYPE_SPECTROGRAMSINK))
+		return FALSE;
 	if (!gst_element_register(plugin, "afc", GST_RANK_NONE,
 	    GST_TYPE_AFC))
 		return FALSE;
+	if (!gst_element_register(plugin, "iqpeaks", GST_RANK_NONE,
+	    GST_TYPE_IQPEAKS))
+		return FALSE;
 	if (!gst_element_register(plugin, "iqamdem", GST_RANK_NONE,
 	    GST_TYPE_IQAMDEM))
 		return FALSE;
+	if (!gst_element_register(plugin, "iqagc", GST_RANK_NONE,
+	    GST_TYPE_IQAGC))
+		return FALSE;
 	if (!gst_element_register(plugin, "bpskrcdem", GST_RANK_NONE,
 	    GST_TYPE_BPSKRCDEM))
 		return FALSE;
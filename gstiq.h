@@ -34,6 +34,10 @@ struct _Gst_iqfshift {
 	float shift;
 	float step;
 	float angle;
+	gchar *controlname;
+	struct iqcontrol *control;	/* 'shift' from here */
+	gint controlseq;
+	float controlscale;
 };
 
 typedef struct _Gst_iqfshift_class Gst_iqfshift_class;
@@ -207,6 +211,64 @@ struct _Gst_firblock_class {
 GType gst_firblock_get_type(void);
 
 
+/********************************************************************
+ *	Shared FFT plans
+ */
+
+enum {
+	FFTPLAN_FORWARD,
+	FFTPLAN_BACKWARD,
+	FFTPLAN_R2C,
+	FFTPLAN_C2R,
+};
+
+fftwf_plan iqfftplan_get(int kind, int length, int howmany, int threads,
+    void *in, void *out);
+void iqfftplan_put(fftwf_plan plan);
+
+
+/********************************************************************
+ *	FFT windows
+ */
+
+enum {
+	WINDOW_RECTANGULAR,
+	WINDOW_SQRTHANN,
+};
+
+float *iqwindow_analysis(int type, int length);
+float *iqwindow_synthesis(int type, int length, int overlap);
+
+
+/********************************************************************
+ *	Control values
+ */
+
+struct iqcontrol;
+
+struct iqcontrol *iqcontrol_get(const char *name);
+void iqcontrol_put(struct iqcontrol *control);
+void iqcontrol_set(struct iqcontrol *control, float value);
+gboolean iqcontrol_read(struct iqcontrol *control, float *value, gint *seq);
+
+
+/********************************************************************
+ *	QoS for elements that draw pictures
+ */
+
+struct iqqos {
+	GstSegment segment;	/* of the incoming stream */
+	GstClockTime earliest;	/* running time, older frames are late */
+};
+
+void iqqos_reset(struct iqqos *qos);
+gboolean iqqos_src_event(struct iqqos *qos, GstElement *element,
+    GstEvent *event);
+void iqqos_sink_event(struct iqqos *qos, GstElement *element,
+    GstEvent *event);
+gboolean iqqos_late(struct iqqos *qos, GstElement *element, GstClockTime ts);
+
+
 /********************************************************************
  *	Complex FFT
  */
@@ -219,9 +281,25 @@ struct _Gst_cmplxfft {
 	GstPad *sinkpad, *srcpad;
 
 	fftwf_complex *buffer;
+	float *rbuffer;		/* input for real (r2c) transforms */
 	fftwf_plan plan;
+	fftwf_plan batchplan;
 	int length;
 	int fill;
+	int rate;
+	int real;
+	int batch;	/* frames per batched transform */
+	int threads;	/* fftw threads for large transforms */
+	int overlap;	/* frames start every length/overlap samples */
+	int hop;	/* that is every 'hop' samples */
+	int window;
+	float *win;
+	guint8 *tail;	/* raw samples shared with the next frame */
+	int reconfigure;	/* properties changed, setup again */
+
+	GTimer *timer;
+	int frames;
+	float fps;
 
 	long offset;
 };
@@ -253,9 +331,17 @@ struct _Gst_cmplxrfft {
 	GstPad *sinkpad, *srcpad;
 
 	fftwf_complex *buffer;
+	float *rbuffer;		/* output for real (c2r) transforms */
 	fftwf_plan plan;
 	int length;
 	int fill;
+	int real;
+	int overlap;
+	int hop;	/* output samples per frame, length/overlap */
+	int window;
+	float *win;
+	fftwf_complex *ola;	/* overlap-add accumulator */
+	int reconfigure;	/* properties changed, setup again */
 
 	long offset;
 };
@@ -290,6 +376,51 @@ enum {
 	FDEMOD_CW,
 };
 
+/* A run of output bins filled from consecutive input bins */
+struct fdemod_span {
+	int dst;
+	int src;
+	int len;
+	int reverse;	/* dst runs down and the bins are conjugated */
+};
+
+enum {
+	FDEMOD_MIRROR_NONE,
+	FDEMOD_MIRROR_UPPER,	/* upper half from the lower half */
+	FDEMOD_MIRROR_LOWER,	/* lower half from the upper half */
+};
+
+/*
+ *	Bin mapping of one demodulator, computed whenever the offset, mode
+ *	or lengths change.
+ */
+struct fdemod_table {
+	int length;		/* output bins */
+	float *gain;		/* passband gain per output bin */
+	struct fdemod_span copy[3];
+	int copies;
+	struct fdemod_span *gaps;	/* output bins that are zero */
+	int ngaps;
+	int mirror;
+	int half;
+	int bin;		/* input bin that ends up at output bin 0 */
+};
+
+/* CW passband around the beat frequency, both in Hz */
+#define FDEMOD_CW_BFO		700
+#define FDEMOD_CW_WIDTH		500
+
+/* Audio output: default rate and AM carrier removal corner in Hz */
+#define FDEMOD_AUDIO_RATE	8000
+#define FDEMOD_AM_DC		10.0
+
+int fdemod_table_setup(struct fdemod_table *table, int mode,
+    int foffset, int sinklength, int srclength, double binwidth,
+    int hermitian, int bfo);
+void fdemod_table_process(struct fdemod_table *table,
+    const float *in, float *out);
+void fdemod_table_free(struct fdemod_table *table);
+
 struct _Gst_iqfdemod {
 	GstElement element;
 
@@ -303,6 +434,22 @@ struct _Gst_iqfdemod {
 	int mode;
 	int offset;
 	int foffset;
+	int hermitian;	/* downstream only reads the lower half */
+	int bfo;
+
+	struct fdemod_table table;
+
+	/* audio output */
+	int audio;
+	fftwf_complex *spectrum;
+	fftwf_plan plan;
+	float dc, dcalpha;	/* AM carrier level */
+	float prev[2];		/* FM: last sample of the previous frame */
+	float rot[2], drot[2];	/* rotation for the sub-bin offset */
+	float *audiobuf;
+	double step;		/* inverse samples per output sample */
+	double pos;
+	float last;
 };
 
 typedef struct _Gst_iqfdemod_class Gst_iqfdemod_class;
@@ -320,6 +467,106 @@ struct _Gst_iqfdemod_class {
 GType gst_iqfdemod_get_type(void);
 
 
+/********************************************************************
+ *	Frequency domain demodulator bank
+ */
+
+typedef struct _Gst_iqfdemodbank Gst_iqfdemodbank;
+
+struct fdemodbank_channel {
+	GstPad *srcpad;
+	int nr;
+
+	int foffset;
+	int mode;
+	int length;	/* 0: from downstream caps */
+	int rate;
+	int dirty;	/* table needs to be set up again */
+
+	struct fdemod_table table;
+	GstBuffer *outbuf;
+	const float *in;
+};
+
+struct _Gst_iqfdemodbank {
+	GstElement element;
+
+	GstPad *sinkpad;
+
+	int sinklength;
+	int sinkrate;
+
+	gchar *config;
+	struct fdemodbank_channel **channels;
+	int nchannels;
+
+	int threads;
+	GThreadPool *pool;
+	GMutex *lock;
+	GCond *done;
+	int pending;
+
+	long offset;
+};
+
+typedef struct _Gst_iqfdemodbank_class Gst_iqfdemodbank_class;
+
+struct _Gst_iqfdemodbank_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_IQFDEMODBANK (gst_iqfdemodbank_get_type())
+#define GST_IQFDEMODBANK(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_IQFDEMODBANK, Gst_iqfdemodbank)
+#define GST_IQFDEMODBANK_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_IQFDEMODBANK, Gst_iqfdemodbank)
+#define GST_IS_IQFDEMODBANK(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_IQFDEMODBANK)
+#define GST_IS_IQFDEMODBANK_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_IQFDEMODBANK)
+
+GType gst_iqfdemodbank_get_type(void);
+
+
+/********************************************************************
+ *	Goertzel tone detector
+ */
+
+typedef struct _Gst_iqgoertzel Gst_iqgoertzel;
+
+struct _Gst_iqgoertzel {
+	GstElement element;
+
+	GstPad *sinkpad, *srcpad;
+
+	int rate;
+	int complex;
+	int blocksize;
+	int size;		/* block size in use */
+	int count;
+	int reconfigure;	/* new frequencies or blocksize */
+
+	gchar *frequencies;
+	int tones;
+	float *coeff;		/* 2 cos(w), owns all arrays below */
+	float *cosw, *sinw;
+	float *s1r, *s1i;	/* filter state, one entry per tone */
+	float *s2r, *s2i;
+
+	long offset;
+};
+
+typedef struct _Gst_iqgoertzel_class Gst_iqgoertzel_class;
+
+struct _Gst_iqgoertzel_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_IQGOERTZEL (gst_iqgoertzel_get_type())
+#define GST_IQGOERTZEL(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_IQGOERTZEL, Gst_iqgoertzel)
+#define GST_IQGOERTZEL_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_IQGOERTZEL, Gst_iqgoertzel)
+#define GST_IS_IQGOERTZEL(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_IQGOERTZEL)
+#define GST_IS_IQGOERTZEL_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_IQGOERTZEL)
+
+GType gst_iqgoertzel_get_type(void);
+
+
 /********************************************************************
  *	FFT Waterall
  */
@@ -331,19 +578,41 @@ struct _Gst_waterfall {
 
 	GstPad *sinkpad, *srcpad;
 
-	unsigned char *buffer;
+	unsigned char *buffer;	/* ring of picture rows */
 	int length;
 	int height;
-	int uoff;
-	int voff;
-	int size;
-	int frame;
+	int rowsize;
+	int head;		/* newest row */
+	int size;		/* of a frame */
 	int rate;
 	int skip;
 	float markerf;
 	int marker;
-	int fcnt;
-	int factor;
+	gchar *markername;
+	struct iqcontrol *markercontrol;	/* 'marker' from here */
+	gint markerseq;
+	int framerate;
+	GstClockTime interval;	/* between rows */
+	GstClockTime time;	/* stream time of the next spectrum */
+	GstClockTime next;	/* next row is due */
+	struct iqqos qos;
+	float reference;	/* dB at full scale */
+	float range;		/* dB from black to full scale */
+	float scale, bias;	/* log2 of power to pixel */
+	int width;		/* requested picture width */
+	int start, span;	/* requested bins */
+	int reduce;
+	int columns;		/* picture width */
+	int first, bins;	/* displayed bins */
+	int center;		/* chroma column of 0 Hz */
+	float *power, *colpower;
+	unsigned char *level;	/* newest row as palette index */
+	int format;
+	int palette;
+	guint32 lut[256];	/* palette as RGB pixels */
+	unsigned char ylut[256], ulut[256], vlut[256];
+	guint32 mark[2];	/* 0 Hz line and marker as RGB pixels */
+	int reconfigure;	/* changes for the streaming thread */
 
 	long offset;
 };
@@ -362,6 +631,48 @@ struct _Gst_waterfall_class {
 
 GType gst_waterfall_get_type(void);
 
+
+/********************************************************************
+ *	Spectrogram archive
+ */
+
+#include "spectrogram.h"
+
+typedef struct _Gst_spectrogramsink Gst_spectrogramsink;
+
+struct _Gst_spectrogramsink {
+	GstElement element;
+
+	GstPad *sinkpad;
+
+	gchar *location;
+	int rate;
+	int length;
+	int levels;
+	int tilerows;
+	float reference;	/* dB at level 255 */
+	float range;		/* dB from level 0 to 255 */
+	float scale, bias;	/* log2 of power to level */
+	unsigned char *row;
+	struct spectrogram *spg;
+	GstBuffer *held;	/* first spectrum, until the interval is known */
+	GstClockTime next;	/* time of the next row */
+};
+
+typedef struct _Gst_spectrogramsink_class Gst_spectrogramsink_class;
+
+struct _Gst_spectrogramsink_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_SPECTROGRAMSINK (gst_spectrogramsink_get_type())
+#define GST_SPECTROGRAMSINK(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_SPECTROGRAMSINK, Gst_spectrogramsink)
+#define GST_SPECTROGRAMSINK_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_SPECTROGRAMSINK, Gst_spectrogramsink)
+#define GST_IS_SPECTROGRAMSINK(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_SPECTROGRAMSINK)
+#define GST_IS_SPECTROGRAMSINK_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_SPECTROGRAMSINK)
+
+GType gst_spectrogramsink_get_type(void);
+
 /********************************************************************
  *	VectorScope
  */
@@ -380,10 +691,25 @@ struct _Gst_vectorscope {
 	int voff;
 	int size;
 	int rate;
-	int fcnt;
-	int framesamples;
-	int samples;
+	int framerate;
+	int reconfigure;	/* new framerate */
+	GstClockTime interval;	/* between frames */
+	GstClockTime time;	/* stream time of the next buffer */
+	GstClockTime next;	/* next frame is due */
+	struct iqqos qos;
 	float decay;
+	float *density;		/* points per pixel times gain */
+	float gain;		/* weight of a new point */
+	float knee;
+	int splat;
+	int mode;
+	float symbolrate;
+	float timing;		/* of the symbol instants, in symbols */
+	float phase;		/* symbols since the last instant */
+	int odd;		/* every second symbol, for the eye */
+	float prev[2];		/* previous sample */
+	float *points;		/* constellation or eye points */
+	int npoints;
 
 	long offset;
 };
@@ -419,9 +745,15 @@ struct _Gst_afc {
 	int mirror;
 	float afc;
 
+	int method;
+	float threshold;	/* dB below the peak */
+	float bandwidth;	/* of the loop filter in Hz */
+	float *power;
+	gchar *controlname;
+	struct iqcontrol *control;	/* afc is published here */
+	GstClockTime last;	/* timestamp of the previous spectrum */
+
 	long offset;
-	
-	float lastf;
 };
 
 typedef struct _Gst_afc_class Gst_afc_class;
@@ -438,6 +770,72 @@ struct _Gst_afc_class {
 
 GType gst_afc_get_type(void);
 
+/********************************************************************
+ *	Peak detector
+ */
+
+/* One carrier in an application/x-iqpeaks buffer */
+struct iqpeak {
+	gint32 id;		/* stays the same while it is tracked */
+	float frequency;	/* Hz from the center */
+	float snr;		/* dB above the noise floor */
+	float bandwidth;	/* -3 dB width in Hz */
+};
+
+/* Histogram bins for the noise floor, 0.5 dB each */
+#define IQPEAKS_HIST 800
+
+struct iqpeaks_track {
+	struct iqpeak peak;
+	int hits;
+	int misses;
+	int seen;
+};
+
+typedef struct _Gst_iqpeaks Gst_iqpeaks;
+
+struct _Gst_iqpeaks {
+	GstElement element;
+
+	GstPad *sinkpad;
+	GstPad *srcpad;
+
+	int rate;
+	int length;
+
+	int percentile;		/* of the levels taken as noise floor */
+	float threshold;	/* dB above the floor */
+	float hysteresis;	/* dB a tracked carrier may drop below it */
+	int hold;		/* frames to keep a lost carrier */
+	int maxpeaks;
+	int reconfigure;	/* new maxpeaks */
+
+	int npeaks;		/* maxpeaks the arrays are sized for */
+	float *db;
+	int hist[IQPEAKS_HIST];
+	float floor;
+	struct iqpeak *found;
+	struct iqpeaks_track *tracks;
+	int ntracks;
+	gint32 nextid;
+
+	long offset;
+};
+
+typedef struct _Gst_iqpeaks_class Gst_iqpeaks_class;
+
+struct _Gst_iqpeaks_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_IQPEAKS (gst_iqpeaks_get_type())
+#define GST_IQPEAKS(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_IQPEAKS, Gst_iqpeaks)
+#define GST_IQPEAKS_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_IQPEAKS, Gst_iqpeaks)
+#define GST_IS_IQPEAKS(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_IQPEAKS)
+#define GST_IS_IQPEAKS_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_IQPEAKS)
+
+GType gst_iqpeaks_get_type(void);
+
 
 /********************************************************************
  *	Frequency demodulator declarations
@@ -451,12 +849,24 @@ struct _Gst_iqfmdem {
 	GstPad *sinkpad, *srcpad;
 
 	int rate;
+	int outrate;
+	int bufferframes;
 	float prevangle;
 	float deviation;
 	float normal;
 	float avrg;
 	float avrglen;
-	float filter;
+
+	int audiorate;		/* 0 for the input rate */
+	float deemphasis;	/* time constant in us */
+	int renegotiate;
+	float lpalpha;
+	float lp;		/* anti-alias pole at the input rate */
+	float sum;		/* integrate-and-dump */
+	int count;
+	int phase;		/* in units of 1/rate s */
+	float dealpha;
+	float filter;		/* de-emphasis */
 
 	long offset;
 };
@@ -475,6 +885,81 @@ struct _Gst_iqfmdem_class {
 
 GType gst_iqfmdem_get_type(void);
 
+/********************************************************************
+ *	Wideband FM stereo decoder
+ */
+
+#define WFM_HBTAPS	63	/* half-band filter length, 4n-1 */
+#define WFM_STAGES	8
+
+struct wfmhalfband {
+	float hist[WFM_HBTAPS * 2];
+	int pos;
+	int odd;
+};
+
+typedef struct _Gst_iqwfmstereo Gst_iqwfmstereo;
+
+struct _Gst_iqwfmstereo {
+	GstElement element;
+
+	GstPad *sinkpad;
+	GstPad *srcpad;
+	GstPad *rdspad;
+
+	gboolean stereo;
+	gboolean rds;
+	float deemphasis;	/* us */
+
+	int rate;
+	int mpxrate, outrate, rdsrate;
+	int mpxstages, audiostages, rdsstages;
+	struct wfmhalfband mpxhb[WFM_STAGES];
+	struct wfmhalfband sumhb[WFM_STAGES], diffhb[WFM_STAGES];
+	struct wfmhalfband rdsihb[WFM_STAGES], rdsqhb[WFM_STAGES];
+
+	/* Pilot PLL, phase in units of 2^-32 cycle */
+	guint32 phase;
+	guint32 step;
+	double integ;
+	double pullin;
+	float kp, ki;
+	float erralpha;
+	float err, amp;
+	float pilotalpha;
+	float pilot;		/* amplitude/2 for the cancellation */
+
+	/* 15 kHz low-pass of the sum and difference */
+	float *fircoef;
+	int firtaps;
+	float *sumhist, *diffhist;
+	int firpos;
+
+	float blend, blendalpha;	/* mono to stereo */
+	float dealpha;
+	float left, right;
+
+	float *work;
+	int worksize;
+
+	long offset;
+	long rdsoffset;
+};
+
+typedef struct _Gst_iqwfmstereo_class Gst_iqwfmstereo_class;
+
+struct _Gst_iqwfmstereo_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_IQWFMSTEREO (gst_iqwfmstereo_get_type())
+#define GST_IQWFMSTEREO(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_IQWFMSTEREO, Gst_iqwfmstereo)
+#define GST_IQWFMSTEREO_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_IQWFMSTEREO, Gst_iqwfmstereo)
+#define GST_IS_IQWFMSTEREO(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_IQWFMSTEREO)
+#define GST_IS_IQWFMSTEREO_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_IQWFMSTEREO)
+
+GType gst_iqwfmstereo_get_type(void);
+
 
 /********************************************************************
  *	Amplitude demodulator declarations
@@ -488,9 +973,17 @@ struct _Gst_iqamdem {
 	GstPad *sinkpad, *srcpad;
 
 	int rate;
+	gboolean complex;	/* input is complex, not polar */
 	float avrg;
 	float avrglen;
 	float depth;
+
+	int mode;
+	float bandwidth;	/* of the carrier PLL */
+	float kp, ki;
+	float pr, pi;		/* oscillator phasor */
+	float freq;		/* radians per sample */
+
 	long offset;
 };
 
@@ -508,6 +1001,55 @@ struct _Gst_iqamdem_class {
 
 GType gst_iqamdem_get_type(void);
 
+/********************************************************************
+ *	Automatic gain control
+ */
+
+typedef struct _Gst_iqagc Gst_iqagc;
+
+struct _Gst_iqagc {
+	GstElement element;
+
+	GstPad *sinkpad;
+	GstPad *srcpad;
+
+	int rate;
+	gboolean complex;
+
+	float level;		/* output peak */
+	float maxgain;		/* dB */
+	float maxgainf;
+	float attack, decay;	/* ms */
+	float attackalpha, decayalpha;
+	float lookahead;	/* ms */
+	int blocksize;
+	int reconfigure;	/* new lookahead or blocksize */
+
+	float gain;
+	int size;		/* block size of the delay */
+	float *delay;		/* 'blocks' blocks of samples */
+	float *peaks;		/* envelope of each block in the delay */
+	int blocks;
+	int block;		/* being filled */
+	int fill;
+
+	long offset;
+};
+
+typedef struct _Gst_iqagc_class Gst_iqagc_class;
+
+struct _Gst_iqagc_class {
+	GstElementClass parent_class;
+};
+
+#define GST_TYPE_IQAGC (gst_iqagc_get_type())
+#define GST_IQAGC(obj) G_TYPE_CHECK_INSTANCE_CAST(obj, GST_TYPE_IQAGC, Gst_iqagc)
+#define GST_IQAGC_CLASS(klass) G_TYPE_CHECK_CLASS_CAST(klass, GST_TYPE_IQAGC, Gst_iqagc)
+#define GST_IS_IQAGC(obj) G_TYPE_CHECK_INSTANCE_TYPE(obj, GST_TYPE_IQAGC)
+#define GST_IS_IQAGC_CLASS(obj) G_TYPE_CHECK_CLASS_TYPE(klass, GST_TYPE_IQAGC)
+
+GType gst_iqagc_get_type(void);
+
 
 /********************************************************************
  *	BPSK-RC demodulator declarations
@@ -0,0 +1,495 @@
+/*
+ *	Find the active carriers in FFT frames.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Every spectrum gets a noise floor: a percentile of the bin levels,
+ *	taken from a histogram of 0.5 dB steps. Runs of bins more than
+ *	'threshold' dB above the floor are carriers, at the interpolated
+ *	frequency of their strongest bin. Their bandwidth is where they
+ *	drop 3 dB below that bin.
+ *	Carriers are tracked from frame to frame and keep their id. A new
+ *	carrier is only reported after it was seen twice, a tracked one
+ *	may drop 'hysteresis' dB below the threshold and is kept for
+ *	'hold' frames after it was last seen.
+ *	The output is an array of struct iqpeak for each frame.
+ */
+
+#include <math.h>
+#include "gstiq.h"
+#include <string.h>
+#include <stdlib.h>
+
+static GstElementDetails iqpeaks_details = GST_ELEMENT_DETAILS(
+	"Peak detector",
+	"Filter/Analyzer/Audio",
+	"Lists the active carriers in FFT frames",
+	"agent (agent@local)"
+);
+
+enum {
+	ARG_0,
+	ARG_PERCENTILE,
+	ARG_THRESHOLD,
+	ARG_HYSTERESIS,
+	ARG_HOLD,
+	ARG_MAXPEAKS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-fft-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"length = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"application/x-iqpeaks"
+	)
+);
+
+/* Histogram of levels from -200 dB, IQPEAKS_HIST steps */
+#define IQPEAKS_HIST_MIN	-200.0
+#define IQPEAKS_HIST_STEP	0.5
+
+static GstElementClass *parent_class = NULL;
+
+/* dB of power 'p', 10 * log10(2) = 3.0103 */
+static inline float gst_iqpeaks_db(float p)
+{
+	return 3.0103 * log2f(p + 1e-30);
+}
+
+/* Levels in dB in display order, negative frequencies first */
+static void gst_iqpeaks_levels(Gst_iqpeaks *peaks, const float *in)
+{
+	int n = peaks->length;
+	int half = n - n / 2;
+	float *db = peaks->db;
+	int d, b;
+
+	for (d = 0; d < n; d++) {
+		b = d < half ? d + n / 2 : d - half;
+		db[d] = gst_iqpeaks_db(in[b*2] * in[b*2] +
+		    in[b*2+1] * in[b*2+1]);
+	}
+}
+
+static float gst_iqpeaks_floor(Gst_iqpeaks *peaks)
+{
+	int *hist = peaks->hist;
+	int i, h, count, want;
+
+	memset(hist, 0, sizeof(int) * IQPEAKS_HIST);
+	for (i = 0; i < peaks->length; i++) {
+		h = (peaks->db[i] - IQPEAKS_HIST_MIN) / IQPEAKS_HIST_STEP;
+		h = h < 0 ? 0 : h >= IQPEAKS_HIST ? IQPEAKS_HIST - 1 : h;
+		hist[h]++;
+	}
+	want = peaks->length * peaks->percentile / 100;
+	for (i = 0, count = 0; i < IQPEAKS_HIST - 1; i++) {
+		count += hist[i];
+		if (count > want)
+			break;
+	}
+	return IQPEAKS_HIST_MIN + (i + 0.5) * IQPEAKS_HIST_STEP;
+}
+
+/*
+ *	Carriers above 'thr' dB. Returns the number found, at most
+ *	'max': when there are more the strongest are kept.
+ *	Frequencies in bins from 0 Hz, levels in dB.
+ */
+static int gst_iqpeaks_find(Gst_iqpeaks *peaks, float thr,
+    struct iqpeak *found, int max)
+{
+	const float *db = peaks->db;
+	int n = peaks->length;
+	int i, j, f, pk, lo, hi, nf = 0, weakest = 0;
+	float d, c;
+
+	for (i = 0; i < n; i++) {
+		if (db[i] < thr)
+			continue;
+		/* A run above the threshold, find its peak */
+		for (pk = i; i < n && db[i] >= thr; i++)
+			if (db[i] > db[pk])
+				pk = i;
+		/* Full, replace the weakest if this one is stronger */
+		if (nf == max) {
+			if (db[pk] <= found[weakest].snr)
+				continue;
+			f = weakest;
+		} else {
+			f = nf++;
+		}
+		/* -3 dB points */
+		for (lo = pk; lo > 0 && db[lo - 1] > db[pk] - 3.0; lo--);
+		for (hi = pk; hi < n - 1 && db[hi + 1] > db[pk] - 3.0; hi++);
+		/* Gaussian fit, a parabola through the dB levels */
+		d = 0.0;
+		if (pk > 0 && pk < n - 1) {
+			c = 2.0 * db[pk] - db[pk - 1] - db[pk + 1];
+			if (c > 0.0)
+				d = 0.5 * (db[pk + 1] - db[pk - 1]) / c;
+		}
+		found[f].id = 0;
+		found[f].frequency = pk + d - (n - n / 2);
+		found[f].snr = db[pk];
+		found[f].bandwidth = hi - lo + 1;
+		if (nf == max) {
+			for (j = 1, weakest = 0; j < nf; j++)
+				if (found[j].snr < found[weakest].snr)
+					weakest = j;
+		}
+	}
+	return nf;
+}
+
+/* Match the carriers found to the tracks, nearest first come */
+static void gst_iqpeaks_track(Gst_iqpeaks *peaks, struct iqpeak *found,
+    int nf, float floor)
+{
+	struct iqpeaks_track *track = peaks->tracks;
+	float binhz = (float)peaks->rate / peaks->length;
+	float dist, best, tol;
+	int i, t, bt;
+
+	for (t = 0; t < peaks->ntracks; t++)
+		track[t].seen = 0;
+
+	for (i = 0; i < nf; i++) {
+		found[i].snr -= floor;
+		found[i].frequency *= binhz;
+		found[i].bandwidth *= binhz;
+
+		bt = -1;
+		best = 0.0;
+		for (t = 0; t < peaks->ntracks; t++) {
+			if (track[t].seen)
+				continue;
+			tol = track[t].peak.bandwidth > 2.0 * binhz ?
+			    track[t].peak.bandwidth : 2.0 * binhz;
+			dist = fabsf(found[i].frequency -
+			    track[t].peak.frequency);
+			if (dist <= tol && (bt < 0 || dist < best)) {
+				bt = t;
+				best = dist;
+			}
+		}
+		if (bt < 0) {
+			/* Only strong enough carriers start a track */
+			if (found[i].snr < peaks->threshold ||
+			    peaks->ntracks >= peaks->npeaks)
+				continue;
+			bt = peaks->ntracks++;
+			track[bt].peak.id = peaks->nextid++;
+			track[bt].hits = 0;
+		}
+		found[i].id = track[bt].peak.id;
+		track[bt].peak = found[i];
+		track[bt].seen = 1;
+		track[bt].hits++;
+		track[bt].misses = 0;
+	}
+
+	/* Forget tracks not seen for too long */
+	for (t = 0; t < peaks->ntracks; ) {
+		if (!track[t].seen && ++track[t].misses > peaks->hold) {
+			track[t] = track[--peaks->ntracks];
+			continue;
+		}
+		t++;
+	}
+}
+
+/* Only from the streaming thread, the chain uses the arrays */
+static int gst_iqpeaks_setup(Gst_iqpeaks *peaks)
+{
+	GST_OBJECT_LOCK(peaks);
+	peaks->npeaks = peaks->maxpeaks;
+	peaks->reconfigure = 0;
+	GST_OBJECT_UNLOCK(peaks);
+
+	free(peaks->db);
+	free(peaks->found);
+	free(peaks->tracks);
+	peaks->db = malloc(sizeof(float) * peaks->length);
+	peaks->found = malloc(sizeof(struct iqpeak) * peaks->npeaks);
+	peaks->tracks = malloc(sizeof(struct iqpeaks_track) *
+	    peaks->npeaks);
+	peaks->ntracks = 0;
+	peaks->floor = NAN;
+	if (!peaks->db || !peaks->found || !peaks->tracks) {
+		free(peaks->db);
+		free(peaks->found);
+		free(peaks->tracks);
+		peaks->db = NULL;
+		peaks->found = NULL;
+		peaks->tracks = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static GstFlowReturn gst_iqpeaks_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_iqpeaks *peaks;
+	GstBuffer *outbuf;
+	GstCaps *caps;
+	struct iqpeak *out;
+	float floor;
+	int nf, t, n, reconfigure;
+
+	peaks = GST_IQPEAKS(gst_pad_get_parent(pad));
+	GST_OBJECT_LOCK(peaks);
+	reconfigure = peaks->reconfigure;
+	GST_OBJECT_UNLOCK(peaks);
+	if (reconfigure && peaks->length)
+		gst_iqpeaks_setup(peaks);
+	if (!peaks->db ||
+	    GST_BUFFER_SIZE(buf) < sizeof(float) * 2 * peaks->length)
+		goto out;
+
+	gst_iqpeaks_levels(peaks, (float *)GST_BUFFER_DATA(buf));
+	floor = gst_iqpeaks_floor(peaks);
+	/* Smooth the floor a little, it is noisy itself */
+	peaks->floor = isnan(peaks->floor) ? floor :
+	    peaks->floor + 0.1 * (floor - peaks->floor);
+	nf = gst_iqpeaks_find(peaks,
+	    peaks->floor + peaks->threshold - peaks->hysteresis,
+	    peaks->found, peaks->npeaks);
+	gst_iqpeaks_track(peaks, peaks->found, nf, peaks->floor);
+
+	/* Report the confirmed tracks */
+	for (t = 0, n = 0; t < peaks->ntracks; t++)
+		if (peaks->tracks[t].hits >= 2)
+			n++;
+	outbuf = gst_buffer_new_and_alloc(n * sizeof(struct iqpeak));
+	out = (struct iqpeak *)GST_BUFFER_DATA(outbuf);
+	for (t = 0; t < peaks->ntracks; t++)
+		if (peaks->tracks[t].hits >= 2)
+			*out++ = peaks->tracks[t].peak;
+	GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
+	GST_BUFFER_OFFSET(outbuf) = peaks->offset++;
+	caps = gst_pad_get_caps(peaks->srcpad);
+	gst_buffer_set_caps(outbuf, caps);
+	gst_caps_unref(caps);
+	gst_pad_push(peaks->srcpad, outbuf);
+
+out:
+	gst_buffer_unref(buf);
+	gst_object_unref(peaks);
+	return GST_FLOW_OK;
+}
+
+static void gst_iqpeaks_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_iqpeaks *peaks;
+
+	g_return_if_fail(GST_IS_IQPEAKS(object));
+	peaks = GST_IQPEAKS(object);
+
+	switch(prop_id) {
+		case ARG_PERCENTILE:
+			peaks->percentile = g_value_get_int(value);
+			break;
+		case ARG_THRESHOLD:
+			peaks->threshold = g_value_get_float(value);
+			break;
+		case ARG_HYSTERESIS:
+			peaks->hysteresis = g_value_get_float(value);
+			break;
+		case ARG_HOLD:
+			peaks->hold = g_value_get_int(value);
+			break;
+		case ARG_MAXPEAKS:
+			GST_OBJECT_LOCK(peaks);
+			peaks->maxpeaks = g_value_get_int(value);
+			peaks->reconfigure = 1;
+			GST_OBJECT_UNLOCK(peaks);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_iqpeaks_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_iqpeaks *peaks;
+
+	g_return_if_fail(GST_IS_IQPEAKS(object));
+	peaks = GST_IQPEAKS(object);
+
+	switch(prop_id) {
+		case ARG_PERCENTILE:
+			g_value_set_int(value, peaks->percentile);
+			break;
+		case ARG_THRESHOLD:
+			g_value_set_float(value, peaks->threshold);
+			break;
+		case ARG_HYSTERESIS:
+			g_value_set_float(value, peaks->hysteresis);
+			break;
+		case ARG_HOLD:
+			g_value_set_int(value, peaks->hold);
+			break;
+		case ARG_MAXPEAKS:
+			g_value_set_int(value, peaks->maxpeaks);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static GstStateChangeReturn gst_iqpeaks_change_state(GstElement *element,
+    GstStateChange transition)
+{
+	return parent_class->change_state(element, transition);
+}
+
+static gboolean gst_iqpeaks_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_iqpeaks *peaks;
+	GstStructure *structure;
+	GstCaps *newcaps;
+	gboolean ret;
+
+	peaks = GST_IQPEAKS(gst_pad_get_parent(pad));
+
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_get_int(structure, "rate", &peaks->rate);
+	gst_structure_get_int(structure, "length", &peaks->length);
+
+	if (gst_iqpeaks_setup(peaks)) {
+		gst_object_unref(peaks);
+		return FALSE;
+	}
+
+	newcaps = gst_caps_copy(
+	    gst_pad_get_pad_template_caps(peaks->srcpad));
+	gst_pad_use_fixed_caps(peaks->srcpad);
+	ret = gst_pad_set_caps(peaks->srcpad, newcaps);
+	gst_caps_unref(newcaps);
+	gst_object_unref(peaks);
+	return ret;
+}
+
+static void gst_iqpeaks_class_init(Gst_iqpeaks_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gobject_class->set_property = gst_iqpeaks_set_property;
+	gobject_class->get_property = gst_iqpeaks_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_PERCENTILE,
+	    g_param_spec_int("percentile", "percentile",
+	    "percentile of the bin levels taken as noise floor",
+	    1, 99, 50, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_THRESHOLD,
+	    g_param_spec_float("threshold", "threshold",
+	    "dB above the noise floor for a new carrier",
+	    0.0, G_MAXFLOAT, 10.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_HYSTERESIS,
+	    g_param_spec_float("hysteresis", "hysteresis",
+	    "dB below the threshold a tracked carrier may drop",
+	    0.0, G_MAXFLOAT, 3.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_HOLD,
+	    g_param_spec_int("hold", "hold",
+	    "frames a carrier is kept after it was last seen",
+	    0, G_MAXINT, 10, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_MAXPEAKS,
+	    g_param_spec_int("max-peaks", "max-peaks",
+	    "most carriers tracked at once",
+	    1, 4096, 32, G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_iqpeaks_change_state;
+
+	gst_element_class_set_details(gstelement_class, &iqpeaks_details);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&src_template));
+}
+
+static void gst_iqpeaks_init(Gst_iqpeaks *peaks)
+{
+	peaks->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&sink_template), "sink");
+
+	gst_pad_set_chain_function(peaks->sinkpad, gst_iqpeaks_chain);
+	gst_element_add_pad(GST_ELEMENT(peaks), peaks->sinkpad);
+
+	peaks->srcpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&src_template), "src");
+	gst_element_add_pad(GST_ELEMENT(peaks), peaks->srcpad);
+
+	gst_pad_set_setcaps_function(peaks->sinkpad, gst_iqpeaks_setcaps);
+
+	peaks->rate = 0;
+	peaks->length = 0;
+	peaks->percentile = 50;
+	peaks->threshold = 10.0;
+	peaks->hysteresis = 3.0;
+	peaks->hold = 10;
+	peaks->maxpeaks = 32;
+	peaks->npeaks = 32;
+	peaks->reconfigure = 0;
+	peaks->db = NULL;
+	peaks->found = NULL;
+	peaks->tracks = NULL;
+	peaks->ntracks = 0;
+	peaks->nextid = 1;
+	peaks->floor = NAN;
+	peaks->offset = 0;
+}
+
+GType gst_iqpeaks_get_type(void)
+{
+	static GType iqpeaks_type = 0;
+
+	if (!iqpeaks_type) {
+		static const GTypeInfo iqpeaks_info = {
+			sizeof(Gst_iqpeaks_class),
+			NULL,
+			NULL,
+			(GClassInitFunc)gst_iqpeaks_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_iqpeaks),
+			0,
+			(GInstanceInitFunc)gst_iqpeaks_init,
+		};
+		iqpeaks_type = g_type_register_static(GST_TYPE_ELEMENT,
+		    "GstIQPeaks", &iqpeaks_info, 0);
+	}
+	return iqpeaks_type;
+}
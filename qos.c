@@ -0,0 +1,94 @@
+/*
+ *	QoS for elements that draw pictures.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	A QoS event from the video sink tells in running time which frames
+ *	would be late. Buffers carry stream timestamps, so the segment from
+ *	the last newsegment event turns those into running time before they
+ *	are compared. QoS events are not passed upstream: a slow display
+ *	must not slow down the rest of the pipeline.
+ *	The element's object lock protects the state, the events and the
+ *	chain come from different threads.
+ */
+
+#include "gstiq.h"
+
+void iqqos_reset(struct iqqos *qos)
+{
+	gst_segment_init(&qos->segment, GST_FORMAT_TIME);
+	qos->earliest = GST_CLOCK_TIME_NONE;
+}
+
+/* Takes QoS events from the src pad, returns TRUE when it did */
+gboolean iqqos_src_event(struct iqqos *qos, GstElement *element,
+    GstEvent *event)
+{
+	GstClockTimeDiff diff;
+	GstClockTime timestamp;
+	gdouble proportion;
+
+	if (GST_EVENT_TYPE(event) != GST_EVENT_QOS)
+		return FALSE;
+	gst_event_parse_qos(event, &proportion, &diff, &timestamp);
+	GST_OBJECT_LOCK(element);
+	if (diff > 0)
+		qos->earliest = timestamp + diff;
+	else
+		qos->earliest = GST_CLOCK_TIME_NONE;
+	GST_OBJECT_UNLOCK(element);
+	gst_event_unref(event);
+	return TRUE;
+}
+
+/* Notes the segment from events on the sink pad, they still go on */
+void iqqos_sink_event(struct iqqos *qos, GstElement *element,
+    GstEvent *event)
+{
+	GstFormat format;
+	gdouble rate, arate;
+	gint64 start, stop, time;
+	gboolean update;
+
+	switch (GST_EVENT_TYPE(event)) {
+		case GST_EVENT_NEWSEGMENT:
+			gst_event_parse_new_segment_full(event, &update, &rate,
+			    &arate, &format, &start, &stop, &time);
+			if (format != GST_FORMAT_TIME)
+				break;
+			GST_OBJECT_LOCK(element);
+			gst_segment_set_newsegment_full(&qos->segment, update,
+			    rate, arate, format, start, stop, time);
+			GST_OBJECT_UNLOCK(element);
+			break;
+		case GST_EVENT_FLUSH_STOP:
+			GST_OBJECT_LOCK(element);
+			iqqos_reset(qos);
+			GST_OBJECT_UNLOCK(element);
+			break;
+		default:
+			break;
+	}
+}
+
+/* Would a frame with stream time 'ts' arrive too late to be shown? */
+gboolean iqqos_late(struct iqqos *qos, GstElement *element, GstClockTime ts)
+{
+	GstClockTime running;
+	gboolean late;
+
+	GST_OBJECT_LOCK(element);
+	running = gst_segment_to_running_time(&qos->segment,
+	    GST_FORMAT_TIME, ts);
+	late = GST_CLOCK_TIME_IS_VALID(qos->earliest) &&
+	    GST_CLOCK_TIME_IS_VALID(running) && running <= qos->earliest;
+	GST_OBJECT_UNLOCK(element);
+	return late;
+}
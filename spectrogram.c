@@ -0,0 +1,303 @@
+/*
+ *	Spectrogram archive files.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Writing maps only the header and the tile each level is filling,
+ *	the file grows one tile at a time. Reading maps the whole file
+ *	and indexes the tiles, a window is then read straight from the
+ *	tiles of the coarsest level that still has enough resolution.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spectrogram.h"
+
+static size_t spectrogram_pages(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) / page * page;
+}
+
+struct spectrogram *spectrogram_create(const char *filename, int rate,
+    int length, int levels, int tilerows, float reference, float range,
+    uint64_t start, uint64_t interval)
+{
+	struct spectrogram *spg;
+	struct spectrogram_header *h;
+	size_t headersize;
+	int k;
+
+	if (length < 1 || tilerows < 1 || !interval)
+		return NULL;
+	if (levels > SPECTROGRAM_LEVELS)
+		levels = SPECTROGRAM_LEVELS;
+	while (levels > 1 && (length >> (levels - 1)) < 1)
+		levels--;
+	if (levels < 1)
+		levels = 1;
+
+	spg = calloc(1, sizeof(struct spectrogram));
+	if (!spg)
+		return NULL;
+	spg->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (spg->fd < 0)
+		goto err_open;
+	headersize = spectrogram_pages(sizeof(struct spectrogram_header));
+	if (ftruncate(spg->fd, headersize))
+		goto err_map;
+	h = mmap(NULL, headersize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    spg->fd, 0);
+	if (h == MAP_FAILED)
+		goto err_map;
+	spg->header = h;
+
+	memcpy(h->magic, SPECTROGRAM_MAGIC, sizeof(h->magic));
+	h->byteorder = SPECTROGRAM_BYTEORDER;
+	h->rate = rate;
+	h->length = length;
+	h->levels = levels;
+	h->tilerows = tilerows;
+	h->headersize = headersize;
+	h->tilesize = spectrogram_pages(SPECTROGRAM_TILEDATA +
+	    (size_t)tilerows * length);
+	h->reference = reference;
+	h->range = range;
+	h->start = start;
+	h->interval = interval;
+	h->tiles = 0;
+	for (k = 0; k < levels; k++) {
+		h->rows[k] = 0;
+		if (k)
+			spg->fold[k] = malloc(length >> k);
+	}
+	return spg;
+
+err_map:
+	close(spg->fd);
+err_open:
+	free(spg);
+	return NULL;
+}
+
+/* Start a new tile at the end of the file for level 'k' at 'time' */
+static int spectrogram_newtile(struct spectrogram *spg, int k,
+    uint64_t time)
+{
+	struct spectrogram_header *h = spg->header;
+	struct spectrogram_tile *tile;
+	off_t offset;
+	void *map;
+
+	if (spg->current[k])
+		munmap(spg->current[k], h->tilesize);
+	spg->current[k] = NULL;
+
+	offset = h->headersize + (off_t)h->tiles * h->tilesize;
+	if (ftruncate(spg->fd, offset + h->tilesize))
+		return -1;
+	map = mmap(NULL, h->tilesize, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    spg->fd, offset);
+	if (map == MAP_FAILED)
+		return -1;
+	spg->current[k] = map;
+	spg->filled[k] = 0;
+
+	tile = map;
+	tile->magic = SPECTROGRAM_TILE;
+	tile->level = k;
+	tile->index = h->rows[k] / ((uint64_t)h->tilerows << k);
+	tile->start = time;
+	h->tiles++;
+	return 0;
+}
+
+static int spectrogram_put(struct spectrogram *spg, int k,
+    const unsigned char *row, uint64_t time)
+{
+	struct spectrogram_header *h = spg->header;
+	unsigned char *fold;
+	int width = h->length >> k;
+	int i;
+
+	if (!spg->current[k] || spg->filled[k] == (h->tilerows << k))
+		if (spectrogram_newtile(spg, k, time))
+			return -1;
+	memcpy(spg->current[k] + SPECTROGRAM_TILEDATA +
+	    (size_t)spg->filled[k] * width, row, width);
+	spg->filled[k]++;
+	h->rows[k]++;
+
+	if (k + 1 >= h->levels)
+		return 0;
+	/* Peak of 2x2 bins for the next level */
+	fold = spg->fold[k + 1];
+	if (!spg->folded[k + 1]) {
+		spg->foldtime[k + 1] = time;
+		for (i = 0; i < width / 2; i++)
+			fold[i] = row[i*2] > row[i*2+1] ?
+			    row[i*2] : row[i*2+1];
+	} else {
+		for (i = 0; i < width / 2; i++) {
+			fold[i] = row[i*2] > fold[i] ? row[i*2] : fold[i];
+			fold[i] = row[i*2+1] > fold[i] ? row[i*2+1] : fold[i];
+		}
+	}
+	if (++spg->folded[k + 1] < 2)
+		return 0;
+	spg->folded[k + 1] = 0;
+	return spectrogram_put(spg, k + 1, fold, spg->foldtime[k + 1]);
+}
+
+/* 'time' is that of the row, a tile starts at the time of its first row */
+int spectrogram_append(struct spectrogram *spg, const unsigned char *row,
+    uint64_t time)
+{
+	return spectrogram_put(spg, 0, row, time);
+}
+
+struct spectrogram *spectrogram_open(const char *filename)
+{
+	struct spectrogram *spg;
+	struct spectrogram_header *h;
+	struct spectrogram_tile *tile;
+	struct stat st;
+	uint64_t n, i;
+	int k;
+
+	spg = calloc(1, sizeof(struct spectrogram));
+	if (!spg)
+		return NULL;
+	spg->fd = open(filename, O_RDONLY);
+	if (spg->fd < 0)
+		goto err_open;
+	if (fstat(spg->fd, &st) || st.st_size < sizeof(*h))
+		goto err_map;
+	spg->mapsize = st.st_size;
+	spg->map = mmap(NULL, spg->mapsize, PROT_READ, MAP_SHARED,
+	    spg->fd, 0);
+	if (spg->map == MAP_FAILED)
+		goto err_map;
+	h = spg->header = (struct spectrogram_header *)spg->map;
+	if (memcmp(h->magic, SPECTROGRAM_MAGIC, sizeof(h->magic)) ||
+	    h->byteorder != SPECTROGRAM_BYTEORDER ||
+	    h->levels < 1 || h->levels > SPECTROGRAM_LEVELS ||
+	    !h->tilesize || !h->interval || h->headersize > spg->mapsize)
+		goto err_header;
+
+	/* A file still being written may have more tiles than mapped */
+	n = (spg->mapsize - h->headersize) / h->tilesize;
+	if (n > h->tiles)
+		n = h->tiles;
+	for (k = 0; k < h->levels; k++) {
+		spg->rows[k] = h->rows[k];
+		spg->ntiles[k] = (spg->rows[k] +
+		    ((uint64_t)h->tilerows << k) - 1) /
+		    ((uint64_t)h->tilerows << k);
+		spg->tile[k] = calloc(spg->ntiles[k] + 1,
+		    sizeof(unsigned char *));
+		if (!spg->tile[k])
+			goto err_header;
+	}
+	for (i = 0; i < n; i++) {
+		tile = (struct spectrogram_tile *)(spg->map +
+		    h->headersize + i * h->tilesize);
+		if (tile->magic != SPECTROGRAM_TILE ||
+		    tile->level >= h->levels ||
+		    tile->index >= spg->ntiles[tile->level])
+			continue;
+		spg->tile[tile->level][tile->index] =
+		    (unsigned char *)tile + SPECTROGRAM_TILEDATA;
+	}
+	return spg;
+
+err_header:
+	for (k = 0; k < SPECTROGRAM_LEVELS; k++)
+		free(spg->tile[k]);
+	munmap(spg->map, spg->mapsize);
+err_map:
+	close(spg->fd);
+err_open:
+	free(spg);
+	return NULL;
+}
+
+/*
+ *	Fill 'out' with 'rows' rows of 'columns' levels covering the time
+ *	from 'start' to 'end' (ns) and the bins from 'bin0' up to 'bin1'.
+ *	Parts not in the file are 0. Returns the level read from.
+ */
+int spectrogram_read(struct spectrogram *spg, uint64_t start, uint64_t end,
+    int bin0, int bin1, unsigned char *out, int rows, int columns)
+{
+	struct spectrogram_header *h = spg->header;
+	const unsigned char *row;
+	uint64_t r0, r1, rr, tilerows;
+	int k, r, c, width;
+
+	if (!spg->map || rows < 1 || columns < 1 || end <= start)
+		return -1;
+	if (bin0 < 0)
+		bin0 = 0;
+	if (bin1 > h->length)
+		bin1 = h->length;
+	if (bin1 <= bin0)
+		return -1;
+	r0 = start > h->start ? (start - h->start) / h->interval : 0;
+	r1 = end > h->start ? (end - h->start) / h->interval : 0;
+	if (r1 <= r0)
+		r1 = r0 + 1;
+
+	/* Coarsest level with at least the requested resolution */
+	for (k = 0; k + 1 < h->levels; k++) {
+		if (((r1 - r0) >> (k + 1)) < rows ||
+		    ((bin1 - bin0) >> (k + 1)) < columns)
+			break;
+	}
+	tilerows = (uint64_t)h->tilerows << k;
+	width = h->length >> k;
+
+	for (r = 0; r < rows; r++) {
+		rr = (r0 + (r1 - r0) * r / rows) >> k;
+		row = NULL;
+		if (rr < spg->rows[k] && spg->tile[k][rr / tilerows])
+			row = spg->tile[k][rr / tilerows] +
+			    (rr % tilerows) * width;
+		for (c = 0; c < columns; c++) {
+			out[r * columns + c] = row ? row[((bin0 +
+			    (uint64_t)(bin1 - bin0) * c / columns) >> k) %
+			    width] : 0;
+		}
+	}
+	return k;
+}
+
+void spectrogram_close(struct spectrogram *spg)
+{
+	int k;
+
+	for (k = 0; k < SPECTROGRAM_LEVELS; k++) {
+		if (spg->current[k])
+			munmap(spg->current[k], spg->header->tilesize);
+		free(spg->fold[k]);
+		free(spg->tile[k]);
+	}
+	if (spg->map)
+		munmap(spg->map, spg->mapsize);
+	else if (spg->header)
+		munmap(spg->header, spg->header->headersize);
+	close(spg->fd);
+	free(spg);
+}
@@ -0,0 +1,104 @@
+/*
+ *	Spectrogram archive files.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	A spectrogram file holds rows of 'length' bins, each bin a level
+ *	from 0 ('range' dB below 'reference') to 255 ('reference' dB).
+ *	The bins are in display order, lowest negative frequency first.
+ *
+ *	The file is a header page followed by tiles of equal size,
+ *	appended as they are needed. Level 0 tiles hold 'tilerows' rows
+ *	of the full spectrum. Each next level halves both the time and
+ *	the frequency resolution (peak of 2x2 bins), so its tiles hold
+ *	twice the rows of half the bins in the same space.
+ *
+ *	Rows are 'interval' apart from 'start', the writer fills gaps in
+ *	the stream with rows of level 0. Each tile also records the time
+ *	of its first row as it was written.
+ *
+ *	This header does not need gstreamer, applications can include it
+ *	to read the files.
+ */
+
+#ifndef _INCLUDE_SPECTROGRAM_H_
+#define _INCLUDE_SPECTROGRAM_H_
+
+#include <stdint.h>
+
+#define SPECTROGRAM_MAGIC	"IQSPGRM1"
+#define SPECTROGRAM_BYTEORDER	0x01020304
+#define SPECTROGRAM_TILE	0x54494c45
+#define SPECTROGRAM_LEVELS	8
+
+struct spectrogram_header {
+	char magic[8];
+	uint32_t byteorder;
+	uint32_t rate;		/* sample rate of the spectra */
+	uint32_t length;	/* bins per row */
+	uint32_t levels;	/* pyramid levels in the file */
+	uint32_t tilerows;	/* rows in a level 0 tile */
+	uint32_t headersize;	/* bytes before the first tile */
+	uint32_t tilesize;	/* bytes from one tile to the next */
+	float reference;	/* dB at level 255 */
+	float range;		/* dB from level 0 to 255 */
+	uint64_t start;		/* time of the first row in ns */
+	uint64_t interval;	/* ns between level 0 rows */
+	uint64_t tiles;		/* tiles in the file */
+	uint64_t rows[SPECTROGRAM_LEVELS];
+};
+
+struct spectrogram_tile {
+	uint32_t magic;
+	uint32_t level;
+	uint64_t index;		/* tile number within its level */
+	uint64_t start;		/* time of the first row in ns */
+};
+
+/* Tile data starts at this offset in the tile */
+#define SPECTROGRAM_TILEDATA	64
+
+struct spectrogram {
+	int fd;
+	struct spectrogram_header *header;
+
+	/*
+	 *	Reading: the whole file, and the tiles of each level by index.
+	 *	The rows as they were when the file was opened, a writer may
+	 *	still be adding to the header.
+	 */
+	unsigned char *map;
+	size_t mapsize;
+	unsigned char **tile[SPECTROGRAM_LEVELS];
+	uint64_t ntiles[SPECTROGRAM_LEVELS];
+	uint64_t rows[SPECTROGRAM_LEVELS];
+
+	/* Writing: the tile being filled and the rows already in it */
+	unsigned char *current[SPECTROGRAM_LEVELS];
+	uint32_t filled[SPECTROGRAM_LEVELS];
+	/* Writing: peak of the rows waiting for the next level */
+	unsigned char *fold[SPECTROGRAM_LEVELS];
+	int folded[SPECTROGRAM_LEVELS];
+	uint64_t foldtime[SPECTROGRAM_LEVELS];	/* of its first row */
+};
+
+struct spectrogram *spectrogram_create(const char *filename, int rate,
+    int length, int levels, int tilerows, float reference, float range,
+    uint64_t start, uint64_t interval);
+int spectrogram_append(struct spectrogram *spg, const unsigned char *row,
+    uint64_t time);
+
+struct spectrogram *spectrogram_open(const char *filename);
+int spectrogram_read(struct spectrogram *spg, uint64_t start, uint64_t end,
+    int bin0, int bin1, unsigned char *out, int rows, int columns);
+
+void spectrogram_close(struct spectrogram *spg);
+
+#endif /* _INCLUDE_SPECTROGRAM_H_ */
@@ -0,0 +1,415 @@
+/*
+ *	Write FFT frames to a spectrogram archive.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Every spectrum becomes one row of levels in the file, the same dB
+ *	scale as the waterfall. The file is created with the first buffer,
+ *	its time and duration give the time axis of the archive. Without a
+ *	duration the spacing of the first two timestamps is used. Spectra
+ *	missing in a gap are written as empty rows, so the rows stay on the
+ *	time axis.
+ *	See spectrogram.h for the file layout and the reader functions.
+ */
+
+#include "gstiq.h"
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+static GstElementDetails spectrogramsink_details = GST_ELEMENT_DETAILS(
+	"Spectrogram archive sink",
+	"Sink/File",
+	"Write FFT frames to a spectrogram archive file",
+	"agent (agent@local)"
+);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-fft-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"length = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+enum {
+	ARG_0,
+	ARG_LOCATION,
+	ARG_LEVELS,
+	ARG_TILEROWS,
+	ARG_REFERENCE,
+	ARG_RANGE,
+};
+
+static GstElementClass *parent_class = NULL;
+
+static void gst_spectrogramsink_base_init(Gst_spectrogramsink_class *klass)
+{
+	GstElementClass *gstelement_class = GST_ELEMENT_CLASS(klass);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+
+	gst_element_class_set_details(gstelement_class,
+	    &spectrogramsink_details);
+}
+
+/* Levels of a spectrum in display order, negative frequencies first */
+static void gst_spectrogramsink_row(Gst_spectrogramsink *sink,
+    const float *in)
+{
+	int n = sink->length;
+	int half = n - n / 2;
+	float p, v;
+	int d, b;
+
+	for (d = 0; d < n; d++) {
+		b = d < half ? d + n / 2 : d - half;
+		p = in[b*2] * in[b*2] + in[b*2+1] * in[b*2+1];
+		v = log2f(p) * sink->scale + sink->bias;
+		v = v < 0.0 ? 0.0 : v;
+		v = v > 255.0 ? 255.0 : v;
+		sink->row[d] = v;
+	}
+}
+
+/* One spectrum into the file, after empty rows for any gap before it */
+static GstFlowReturn gst_spectrogramsink_write(Gst_spectrogramsink *sink,
+    GstBuffer *buf)
+{
+	GstClockTime ts, interval;
+	guint64 missing;
+
+	interval = sink->spg->header->interval;
+	ts = GST_BUFFER_TIMESTAMP(buf);
+	if (!GST_CLOCK_TIME_IS_VALID(ts))
+		ts = sink->next;
+	if (ts > sink->next) {
+		missing = (ts - sink->next + interval / 2) / interval;
+		memset(sink->row, 0, sink->length);
+		for (; missing; missing--) {
+			if (spectrogram_append(sink->spg, sink->row,
+			    sink->next))
+				return GST_FLOW_ERROR;
+			sink->next += interval;
+		}
+	}
+
+	gst_spectrogramsink_row(sink, (float *)GST_BUFFER_DATA(buf));
+	if (spectrogram_append(sink->spg, sink->row, ts))
+		return GST_FLOW_ERROR;
+	sink->next = ts + interval;
+	return GST_FLOW_OK;
+}
+
+/* The file, with the spectrum held back for the interval as first row */
+static GstFlowReturn gst_spectrogramsink_create(Gst_spectrogramsink *sink,
+    GstClockTime start, GstClockTime interval)
+{
+	GstFlowReturn ret = GST_FLOW_OK;
+
+	if (!GST_CLOCK_TIME_IS_VALID(start))
+		start = 0;
+	sink->spg = spectrogram_create(sink->location, sink->rate,
+	    sink->length, sink->levels, sink->tilerows,
+	    sink->reference, sink->range, start, interval);
+	if (!sink->spg)
+		return GST_FLOW_ERROR;
+	sink->next = start;
+	if (sink->held) {
+		ret = gst_spectrogramsink_write(sink, sink->held);
+		gst_buffer_unref(sink->held);
+		sink->held = NULL;
+	}
+	return ret;
+}
+
+static GstFlowReturn gst_spectrogramsink_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_spectrogramsink *sink;
+	GstClockTime start, interval;
+	GstFlowReturn ret = GST_FLOW_OK;
+
+	sink = GST_SPECTROGRAMSINK(gst_pad_get_parent(pad));
+
+	if (!sink->row ||
+	    GST_BUFFER_SIZE(buf) < sizeof(float) * 2 * sink->length)
+		goto out;
+
+	if (!sink->spg) {
+		if (!sink->location) {
+			ret = GST_FLOW_ERROR;
+			goto out;
+		}
+		start = GST_BUFFER_TIMESTAMP(buf);
+		interval = GST_BUFFER_DURATION(buf);
+		if (!GST_CLOCK_TIME_IS_VALID(interval) || !interval) {
+			/* Wait for a second timestamp to find the interval */
+			if (GST_CLOCK_TIME_IS_VALID(start) && !sink->held) {
+				sink->held = buf;
+				gst_object_unref(sink);
+				return GST_FLOW_OK;
+			}
+			if (sink->held && GST_CLOCK_TIME_IS_VALID(start) &&
+			    start > GST_BUFFER_TIMESTAMP(sink->held))
+				interval = start -
+				    GST_BUFFER_TIMESTAMP(sink->held);
+			else
+				interval = gst_util_uint64_scale_int(
+				    GST_SECOND, sink->length, sink->rate);
+		}
+		if (sink->held)
+			start = GST_BUFFER_TIMESTAMP(sink->held);
+		ret = gst_spectrogramsink_create(sink, start, interval);
+		if (ret != GST_FLOW_OK)
+			goto out;
+	}
+
+	ret = gst_spectrogramsink_write(sink, buf);
+
+out:
+	gst_buffer_unref(buf);
+	gst_object_unref(sink);
+	return ret;
+}
+
+/*
+ *	Not a GstBaseSink, so EOS is told to the pipeline here. A spectrum
+ *	still held back for the interval is written first.
+ */
+static gboolean gst_spectrogramsink_event(GstPad *pad, GstEvent *event)
+{
+	Gst_spectrogramsink *sink;
+
+	sink = GST_SPECTROGRAMSINK(gst_pad_get_parent(pad));
+	if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+		if (!sink->spg && sink->held && sink->location)
+			gst_spectrogramsink_create(sink,
+			    GST_BUFFER_TIMESTAMP(sink->held),
+			    gst_util_uint64_scale_int(GST_SECOND,
+			    sink->length, sink->rate));
+		gst_element_post_message(GST_ELEMENT(sink),
+		    gst_message_new_eos(GST_OBJECT(sink)));
+	}
+	gst_event_unref(event);
+	gst_object_unref(sink);
+	return TRUE;
+}
+
+static void gst_spectrogramsink_close(Gst_spectrogramsink *sink)
+{
+	if (sink->spg)
+		spectrogram_close(sink->spg);
+	sink->spg = NULL;
+	if (sink->held)
+		gst_buffer_unref(sink->held);
+	sink->held = NULL;
+}
+
+/* Same scale as the waterfall, see gst_waterfall_levels() */
+static void gst_spectrogramsink_levels(Gst_spectrogramsink *sink)
+{
+	sink->scale = 10.0 * M_LN2 / M_LN10 * 255.0 / sink->range;
+	sink->bias = (20.0 * log10(sink->length) -
+	    sink->reference + sink->range) * 255.0 / sink->range;
+}
+
+static void gst_spectrogramsink_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_spectrogramsink *sink;
+
+	g_return_if_fail(GST_IS_SPECTROGRAMSINK(object));
+	sink = GST_SPECTROGRAMSINK(object);
+
+	/* The file keeps the settings it was created with */
+	switch(prop_id) {
+		case ARG_LOCATION:
+			g_free(sink->location);
+			sink->location = g_strdup(g_value_get_string(value));
+			break;
+		case ARG_LEVELS:
+			sink->levels = g_value_get_int(value);
+			break;
+		case ARG_TILEROWS:
+			sink->tilerows = g_value_get_int(value);
+			break;
+		case ARG_REFERENCE:
+			sink->reference = g_value_get_float(value);
+			break;
+		case ARG_RANGE:
+			sink->range = g_value_get_float(value);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_spectrogramsink_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_spectrogramsink *sink;
+
+	g_return_if_fail(GST_IS_SPECTROGRAMSINK(object));
+	sink = GST_SPECTROGRAMSINK(object);
+
+	switch(prop_id) {
+		case ARG_LOCATION:
+			g_value_set_string(value, sink->location);
+			break;
+		case ARG_LEVELS:
+			g_value_set_int(value, sink->levels);
+			break;
+		case ARG_TILEROWS:
+			g_value_set_int(value, sink->tilerows);
+			break;
+		case ARG_REFERENCE:
+			g_value_set_float(value, sink->reference);
+			break;
+		case ARG_RANGE:
+			g_value_set_float(value, sink->range);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static GstStateChangeReturn gst_spectrogramsink_change_state(
+    GstElement *element, GstStateChange transition)
+{
+	Gst_spectrogramsink *sink = GST_SPECTROGRAMSINK(element);
+	GstStateChangeReturn ret;
+
+	ret = parent_class->change_state(element, transition);
+	if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+		gst_spectrogramsink_close(sink);
+	return ret;
+}
+
+static gboolean gst_spectrogramsink_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_spectrogramsink *sink;
+	GstStructure *structure;
+	gboolean ret;
+	int rate, length;
+
+	sink = GST_SPECTROGRAMSINK(gst_pad_get_parent(pad));
+
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_get_int(structure, "rate", &rate);
+	gst_structure_get_int(structure, "length", &length);
+
+	/* A new format needs a new file */
+	if (sink->spg && (rate != sink->rate || length != sink->length)) {
+		gst_object_unref(sink);
+		return FALSE;
+	}
+	sink->rate = rate;
+	sink->length = length;
+	free(sink->row);
+	sink->row = malloc(length);
+	gst_spectrogramsink_levels(sink);
+	ret = sink->row != NULL;
+
+	gst_object_unref(sink);
+	return ret;
+}
+
+static void gst_spectrogramsink_class_init(Gst_spectrogramsink_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gobject_class->set_property = gst_spectrogramsink_set_property;
+	gobject_class->get_property = gst_spectrogramsink_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_LOCATION,
+	    g_param_spec_string("location", "location",
+	    "archive file to write", NULL, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_LEVELS,
+	    g_param_spec_int("levels", "levels",
+	    "pyramid levels, each halves time and frequency resolution",
+	    1, SPECTROGRAM_LEVELS, 4, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_TILEROWS,
+	    g_param_spec_int("tilerows", "tilerows",
+	    "rows per tile at full resolution",
+	    1, 65536, 256, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_REFERENCE,
+	    g_param_spec_float("reference", "reference",
+	    "level in dB stored as 255",
+	    -G_MAXFLOAT, G_MAXFLOAT, 48.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_RANGE,
+	    g_param_spec_float("range", "range",
+	    "dB below the reference level stored as 0",
+	    1.0, G_MAXFLOAT, 96.0, G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_spectrogramsink_change_state;
+}
+
+static void gst_spectrogramsink_init(Gst_spectrogramsink *sink)
+{
+	sink->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&sink_template), "sink");
+
+	gst_pad_set_chain_function(sink->sinkpad, gst_spectrogramsink_chain);
+	gst_pad_set_setcaps_function(sink->sinkpad,
+	    gst_spectrogramsink_setcaps);
+	gst_pad_set_event_function(sink->sinkpad, gst_spectrogramsink_event);
+	gst_element_add_pad(GST_ELEMENT(sink), sink->sinkpad);
+	/* The pipeline waits for the EOS of its sinks */
+	GST_OBJECT_FLAG_SET(sink, GST_ELEMENT_IS_SINK);
+
+	sink->location = NULL;
+	sink->rate = 0;
+	sink->length = 0;
+	sink->levels = 4;
+	sink->tilerows = 256;
+	sink->reference = 48.0;
+	sink->range = 96.0;
+	sink->row = NULL;
+	sink->spg = NULL;
+	sink->held = NULL;
+	sink->next = 0;
+}
+
+GType gst_spectrogramsink_get_type(void)
+{
+	static GType spectrogramsink_type = 0;
+
+	if (!spectrogramsink_type) {
+		static const GTypeInfo spectrogramsink_info = {
+			sizeof(Gst_spectrogramsink_class),
+			(GBaseInitFunc)gst_spectrogramsink_base_init,
+			NULL,
+			(GClassInitFunc)gst_spectrogramsink_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_spectrogramsink),
+			0,
+			(GInstanceInitFunc)gst_spectrogramsink_init,
+		};
+		spectrogramsink_type = g_type_register_static(
+		    GST_TYPE_ELEMENT, "GstSpectrogramSink",
+		    &spectrogramsink_info, 0);
+	}
+	return spectrogramsink_type;
+}
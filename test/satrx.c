@@ -58,25 +58,6 @@ static void new_pad(GstElement *element, GstPad *pad, GstElement *other)
 	gst_pad_link(pad, gst_element_get_pad(other, "sink"));
 }
 
-struct afc_context {
-	GstElement *fshift;
-	GstElement *waterfall;
-	int cnt;
-};
-
-static gboolean new_afc_value(GstPad *pad, GstBuffer *buffer,
-    struct afc_context *context)
-{
-	gfloat *afc = (gfloat *)GST_BUFFER_DATA(buffer);
-
-	g_object_set(G_OBJECT(context->waterfall), "marker", *afc, NULL);
-	g_object_set(G_OBJECT(context->fshift), "shift", -*afc, NULL);
-	if (context->cnt++ % 10 == 0)
-		fprintf(stderr, "AFC: %f\n", *afc);
-
-	return TRUE;
-}
-
 static gboolean new_kiss_data(GstPad *pad, GstBuffer *buffer, gpointer nop)
 {
 	unsigned char *data = GST_BUFFER_DATA(buffer);
@@ -94,12 +75,11 @@ int main (int argc, char **argv)
 	GstElement *cmplxfft, *teefft;
 	GstElement *waterfall, *imagesink;
 	GstElement *fshift, *filter, *teecor;
-	GstElement *afc, *fakesink;
+	GstElement *afc;
 	GstElement *queue1, *queue2, *queue3, *queue4, *queue5, *queue6;
 	GstElement *cmplxout, *aconvout, *audiosink;
 	GstElement *polar, *bpskrcdem, *nrzikiss, *kisssink;
 	GstCaps *caps;
-	struct afc_context afc_context;
 
 	gst_init (&argc, &argv);
 
@@ -138,6 +118,8 @@ int main (int argc, char **argv)
 	g_assert(queue2);
 	queue3 = gst_element_factory_make("queue", "queue3");
 	g_assert(queue3);
+	/* The display may drop data, the decoders should not wait for it */
+	g_object_set(G_OBJECT(queue3), "leaky", 2, NULL);
 	queue4 = gst_element_factory_make("queue", "queue4");
 	g_assert(queue4);
 	queue5 = gst_element_factory_make("queue", "queue5");
@@ -152,11 +134,14 @@ int main (int argc, char **argv)
 
 	afc = gst_element_factory_make("afc", "afc");
 	g_assert(afc);
-	fakesink = gst_element_factory_make("fakesink", "fakesink");
-	g_assert(fakesink);
+	/* The afc steers fshift and the waterfall marker directly */
+	g_object_set(G_OBJECT(afc), "control", "afc", NULL);
+	g_object_set(G_OBJECT(waterfall), "marker-control", "afc", NULL);
 	
 	fshift = gst_element_factory_make("iqfshift", "fshift");
 	g_assert(fshift);
+	g_object_set(G_OBJECT(fshift), "control", "afc", NULL);
+	g_object_set(G_OBJECT(fshift), "control-scale", -1.0, NULL);
 	filter = gst_element_factory_make("firblock", "filter");
 	g_assert(filter);
 	g_object_set(G_OBJECT(filter), "frequency", 1300, NULL);
@@ -183,7 +168,7 @@ int main (int argc, char **argv)
 	    tee, queue1, queue2, queue4,
 	    cmplxfft, teefft,
 	    queue3, waterfall, imagesink,
-	    afc, fakesink,
+	    afc,
 	    fshift, filter, teecor,
 	    queue5, polar, bpskrcdem, nrzikiss, kisssink,
 	    queue6, cmplxout, aconvout, audiosink,
@@ -202,13 +187,8 @@ int main (int argc, char **argv)
 	gst_element_link_many(teecor, queue6, cmplxout, aconvout, audiosink, NULL);
 	gst_element_link_many(tee, queue2, cmplxfft, teefft, NULL);
 	gst_element_link_many(teefft, queue3, waterfall, imagesink, NULL);
-	gst_element_link_many(teefft, queue4, afc, fakesink, NULL);
+	gst_element_link_many(teefft, queue4, afc, NULL);
 
-	afc_context.fshift = fshift;
-	afc_context.waterfall = waterfall;
-	afc_context.cnt = 0;
-	gst_pad_add_buffer_probe(gst_element_get_pad(afc, "src"),
-	    G_CALLBACK(new_afc_value), &afc_context);
 	gst_pad_add_buffer_probe(gst_element_get_pad(kisssink, "sink"),
 	    G_CALLBACK(new_kiss_data), NULL);
 
@@ -68,7 +68,7 @@ static void new_pad(GstElement *element, GstPad *pad, GstElement *other)
 int main (int argc, char **argv)
 {
 	GstElement *bin, *filesrc, *decoder, *aconvin, *cmplxin, *tee;
-	GstElement *filter, *filter2, *polar, *demod, *aconvout, *audiosink;
+	GstElement *filter, *filter2, *polar = NULL, *demod, *aconvout, *audiosink;
 	GstElement *cmplxfft, *waterfall, *imagesink;
 	GstElement *queue1, *queue2;
 
@@ -108,6 +108,8 @@ int main (int argc, char **argv)
 	g_assert(queue1);
 	queue2 = gst_element_factory_make("queue", "queue2");
 	g_assert(queue2);
+	/* The display may drop data, the decoders should not wait for it */
+	g_object_set(G_OBJECT(queue2), "leaky", 2, NULL);
 
 	waterfall = gst_element_factory_make("waterfall", "waterfall");
 	g_assert(waterfall);
@@ -123,15 +125,15 @@ int main (int argc, char **argv)
 	g_object_set(G_OBJECT(filter2), "frequency", 4000, NULL);
 	g_object_set(G_OBJECT(filter2), "depth", 2, NULL);
 
-	polar = gst_element_factory_make("iqpolar", "polar");
-	g_assert(polar);
-
 	if (!strcmp(argv[2], "fm")) {
 		printf("Using FM demodulator\n");
+		polar = gst_element_factory_make("iqpolar", "polar");
+		g_assert(polar);
 		demod = gst_element_factory_make("iqfmdem", "demod");
 	} else {
 		printf("Using AM demodulator\n");
 		demod = gst_element_factory_make("iqamdem", "demod");
+		g_object_set(G_OBJECT(demod), "mode", 1, NULL);
 	}
 	g_assert(demod);
  
@@ -143,14 +145,21 @@ int main (int argc, char **argv)
 	gst_bin_add_many (GST_BIN (bin), filesrc, decoder, aconvin, cmplxin,
 	    tee, queue1,
 	    queue2, cmplxfft, waterfall, imagesink,
-	    filter, polar, demod, aconvout, audiosink,
+	    filter, demod, aconvout, audiosink,
 	    NULL);
 
 	gst_element_link(filesrc, decoder);
 	g_signal_connect(decoder, "pad-added", G_CALLBACK(new_pad), aconvin);
 	gst_element_link_many(aconvin, cmplxin, tee, NULL);
-	gst_element_link_many(tee, queue1, filter, polar, demod,
-	    aconvout, audiosink, NULL);
+	/* The AM demodulator takes the complex signal directly */
+	if (!strcmp(argv[2], "fm")) {
+		gst_bin_add(GST_BIN(bin), polar);
+		gst_element_link_many(tee, queue1, filter, polar, demod,
+		    aconvout, audiosink, NULL);
+	} else {
+		gst_element_link_many(tee, queue1, filter, demod,
+		    aconvout, audiosink, NULL);
+	}
 	gst_element_link_many(tee, queue2, cmplxfft, waterfall, imagesink, NULL);
 
 	printf("Playing\n");
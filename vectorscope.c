@@ -11,6 +11,8 @@
 
 #include "gstiq.h"
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
 static GstElementDetails vector_details = GST_ELEMENT_DETAILS(
 	"Vectorscope plugin",
@@ -42,7 +44,19 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 
 enum {
 	ARG_0,
-	ARG_DECAY
+	ARG_DECAY,
+	ARG_FRAMERATE,
+	ARG_KNEE,
+	ARG_SPLAT,
+	ARG_MODE,
+	ARG_SYMBOLRATE,
+	ARG_OFFSET,
+};
+
+enum {
+	VECTORSCOPE_RAW,
+	VECTORSCOPE_CONSTELLATION,
+	VECTORSCOPE_EYE,
 };
 
 static GstPadTemplate *src_template;
@@ -61,7 +75,7 @@ static void gst_vectorscope_base_init(Gst_vectorscope_class *klass)
 	        "format", GST_TYPE_FOURCC, format,
 		"width", G_TYPE_INT, 256,
 		"height", G_TYPE_INT, 256,
-		"framerate", GST_TYPE_FRACTION, 25, 1, NULL));
+		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 1000, 1, NULL));
 
 	src_template = gst_pad_template_new("src", GST_PAD_SRC,
 	     GST_PAD_ALWAYS, capslist);
@@ -73,51 +87,240 @@ static void gst_vectorscope_base_init(Gst_vectorscope_class *klass)
 	gst_element_class_set_details(gstelement_class, &vector_details);
 }
 
-static GstFlowReturn gst_vectorscope_chain(GstPad *pad, GstBuffer *buf)
+/*
+ *	Points are added to a density map. Instead of fading the whole
+ *	map every frame new points get heavier: 'gain' grows by 1/decay
+ *	each frame and the map is divided by it when a picture is made.
+ *	Once the gain gets large the map is scaled back in one pass.
+ */
+static void gst_vectorscope_plot(Gst_vectorscope *vector, const float *val,
+    int n)
+{
+	float *density = vector->density;
+	float g = vector->gain;
+	float fx, fy, ax, ay;
+	int w = vector->width;
+	int h = vector->height;
+	int i, x, y;
+
+	if (!vector->splat) {
+		for (i = 0; i < n; i++) {
+			x = val[i*2] * (w/2) + w/2;
+			y = h/2 - val[i*2+1] * (h/2);
+			x = x < 0 ? 0 : x >= w ? w - 1 : x;
+			y = y < 0 ? 0 : y >= h ? h - 1 : y;
+			density[y * w + x] += g;
+		}
+		return;
+	}
+	/* Spread each point over the four nearest pixels */
+	for (i = 0; i < n; i++) {
+		fx = val[i*2] * (w/2) + w/2 - 0.5;
+		fy = h/2 - val[i*2+1] * (h/2) - 0.5;
+		fx = fx < 0.0 ? 0.0 : fx > w - 1.001 ? w - 1.001 : fx;
+		fy = fy < 0.0 ? 0.0 : fy > h - 1.001 ? h - 1.001 : fy;
+		x = fx;
+		y = fy;
+		ax = fx - x;
+		ay = fy - y;
+		density[y * w + x] += g * (1.0 - ax) * (1.0 - ay);
+		density[y * w + x + 1] += g * ax * (1.0 - ay);
+		density[(y + 1) * w + x] += g * (1.0 - ax) * ay;
+		density[(y + 1) * w + x + 1] += g * ax * ay;
+	}
+}
+
+/*
+ *	Turn 'n' samples into points. Constellations are plotted only at
+ *	the symbol instants, interpolated between the samples around it.
+ *	The eye diagram plots the in-phase part against the time over two
+ *	symbols, with a symbol instant in the middle.
+ *	'phase' is the time since the last symbol instant in symbols.
+ */
+static void gst_vectorscope_samples(Gst_vectorscope *vector,
+    const float *val, int n)
+{
+	float *points;
+	float step = vector->symbolrate / vector->rate;
+	float ph, a;
+	int i, np = 0;
+
+	if (vector->mode == VECTORSCOPE_RAW) {
+		gst_vectorscope_plot(vector, val, n);
+		return;
+	}
+	if (n > vector->npoints) {
+		free(vector->points);
+		vector->points = malloc(sizeof(float) * 2 * n);
+		vector->npoints = vector->points ? n : 0;
+		if (!vector->points)
+			return;
+	}
+	points = vector->points;
+
+	for (i = 0; i < n; i++) {
+		ph = vector->phase + step;
+		if (ph >= 1.0) {
+			ph -= 1.0;
+			vector->odd = !vector->odd;
+			if (vector->mode == VECTORSCOPE_CONSTELLATION) {
+				a = 1.0 - ph / step;
+				points[np*2] = vector->prev[0] +
+				    a * (val[i*2] - vector->prev[0]);
+				points[np*2+1] = vector->prev[1] +
+				    a * (val[i*2+1] - vector->prev[1]);
+				np++;
+			}
+		}
+		if (vector->mode == VECTORSCOPE_EYE) {
+			points[np*2] = ph + vector->odd - 1.0;
+			points[np*2+1] = val[i*2];
+			np++;
+		}
+		vector->phase = ph;
+		vector->prev[0] = val[i*2];
+		vector->prev[1] = val[i*2+1];
+	}
+	gst_vectorscope_plot(vector, points, np);
+}
+
+/* Density to luma: 'knee' shows as half brightness */
+static void gst_vectorscope_tonemap(Gst_vectorscope *vector,
+    unsigned char *out)
+{
+	const float *density = vector->density;
+	float scale = 1.0 / (vector->gain * vector->knee);
+	float v;
+	int i;
+
+	for (i = 0; i < vector->uoff; i++) {
+		v = density[i] * scale;
+		out[i] = 255.0 * v / (v + 1.0);
+	}
+}
+
+static void gst_vectorscope_decay(Gst_vectorscope *vector)
+{
+	float scale;
+	int i;
+
+	if (vector->decay <= 0.0) {
+		memset(vector->density, 0, sizeof(float) * vector->uoff);
+		vector->gain = 1.0;
+		return;
+	}
+	vector->gain /= vector->decay;
+	if (vector->gain < 1e6)
+		return;
+	scale = 1.0 / vector->gain;
+	for (i = 0; i < vector->uoff; i++)
+		vector->density[i] *= scale;
+	vector->gain = 1.0;
+}
+
+/* Push the picture for stream time 'ts' and let it fade */
+static void gst_vectorscope_frame(Gst_vectorscope *vector, GstClockTime ts)
 {
-	Gst_vectorscope *vector;
 	GstBuffer *outbuf;
 	GstCaps *caps;
+
+	/* Don't build frames the sink would drop anyway */
+	if (!iqqos_late(&vector->qos, GST_ELEMENT(vector), ts) &&
+	    gst_pad_is_linked(vector->srcpad)) {
+		outbuf = gst_buffer_new_and_alloc(vector->size);
+		gst_vectorscope_tonemap(vector, GST_BUFFER_DATA(outbuf));
+		/* The graticule */
+		memcpy(GST_BUFFER_DATA(outbuf) + vector->uoff,
+		    vector->buffer + vector->uoff,
+		    vector->size - vector->uoff);
+		caps = gst_pad_get_caps(vector->srcpad);
+		gst_buffer_set_caps(outbuf, caps);
+		gst_caps_unref(caps);
+		GST_BUFFER_TIMESTAMP(outbuf) = ts;
+		GST_BUFFER_OFFSET(outbuf) = vector->offset++;
+		gst_pad_push(vector->srcpad, outbuf);
+	}
+	gst_vectorscope_decay(vector);
+}
+
+/* Sample in a buffer starting at 'ts' at which the next frame is due */
+static guint64 gst_vectorscope_due(Gst_vectorscope *vector, GstClockTime ts)
+{
+	if (vector->next <= ts)
+		return 0;
+	return gst_util_uint64_scale_int(vector->next - ts, vector->rate,
+	    GST_SECOND);
+}
+
+/* Frames are pushed at 'framerate' */
+static gboolean gst_vectorscope_setsrccaps(Gst_vectorscope *vector)
+{
+	GstStructure *structure;
+	GstCaps *newcaps;
+	gboolean ret;
+
+	vector->interval = GST_SECOND / vector->framerate;
+	newcaps = gst_caps_copy(
+	    gst_pad_get_pad_template_caps(vector->srcpad));
+	structure = gst_caps_get_structure(newcaps, 0);
+	gst_structure_set(structure, "framerate", GST_TYPE_FRACTION,
+	    vector->framerate, 1, NULL);
+	gst_pad_use_fixed_caps(vector->srcpad);
+	ret = gst_pad_set_caps(vector->srcpad, newcaps);
+	gst_caps_unref(newcaps);
+	return ret;
+}
+
+static GstFlowReturn gst_vectorscope_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_vectorscope *vector;
+	GstClockTime ts;
+	guint64 due;
 	float *val;
-	float decay;
-	int xcent, ycent, x, y;
-	int i;
+	int i, n, end, reconfigure;
 
 	vector = GST_VECTORSCOPE(gst_pad_get_parent(pad));
-	decay = vector->decay;
+	GST_OBJECT_LOCK(vector);
+	reconfigure = vector->reconfigure;
+	vector->reconfigure = 0;
+	GST_OBJECT_UNLOCK(vector);
+	if (!vector->density || !vector->rate)
+		goto out;
+	/* A new framerate, the pacing follows from the new interval */
+	if (reconfigure)
+		gst_vectorscope_setsrccaps(vector);
 
 	val = (float *)GST_BUFFER_DATA(buf);
-	xcent = vector->width/2;
-	ycent = vector->height/2;
-	for (i = 0; i < GST_BUFFER_SIZE(buf)/sizeof(float); i+=2) {
-		x = val[i] * xcent + xcent;
-		y = ycent - val[i+1] * ycent;
-		if (x < 0)
-			x = 0;
-		if (x >= vector->width)
-			x = vector->width - 1;
-		if (y < 0)
-			y = 0;
-		if (y >= vector->height)
-			y = vector->height - 1;
-		vector->buffer[y * vector->width + x] =255;
-		vector->samples++;
-		if (vector->samples == vector->framesamples) {
-			outbuf = gst_buffer_new_and_alloc(vector->size);
-			memcpy(GST_BUFFER_DATA(outbuf), vector->buffer,
-			    vector->size);
-			caps = gst_pad_get_caps(vector->srcpad);
-			gst_buffer_set_caps(outbuf, caps);
-			gst_caps_unref(caps);
-			GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
-			GST_BUFFER_OFFSET(outbuf) = vector->offset++;
-			gst_pad_push(vector->srcpad, outbuf);
-			vector->samples = 0;
-			for (i = 0; i < vector->uoff; i++)
-				vector->buffer[i] *= decay;
+	n = GST_BUFFER_SIZE(buf)/sizeof(float)/2;
+
+	/* Without timestamps count the stream time ourselves */
+	ts = GST_BUFFER_TIMESTAMP(buf);
+	if (!GST_CLOCK_TIME_IS_VALID(ts))
+		ts = vector->time;
+	vector->time = ts + gst_util_uint64_scale_int(GST_SECOND, n,
+	    vector->rate);
+	/* A jump in the timestamps restarts the pacing */
+	if (!GST_CLOCK_TIME_IS_VALID(vector->next) ||
+	    vector->next + vector->interval < ts ||
+	    vector->next > vector->time + vector->interval)
+		vector->next = ts + vector->interval;
+	due = gst_vectorscope_due(vector, ts);
+
+	/* Plot up to and including the sample a frame is due at */
+	for (i = 0; i < n; i = end) {
+		end = due < n ? due + 1 : n;
+		gst_vectorscope_samples(vector, val + i*2, end - i);
+		if (end - 1 == due) {
+			gst_vectorscope_frame(vector, vector->next);
+			vector->next += vector->interval;
+			due = gst_vectorscope_due(vector, ts);
+			/* Never go back in the buffer */
+			if (due < end)
+				due = end;
 		}
 	}
 
+out:
 	gst_buffer_unref(buf);
 	gst_object_unref(vector);
 	return GST_FLOW_OK;
@@ -135,6 +338,12 @@ static int gst_vectorscope_setup(Gst_vectorscope *vector)
 		free(vector->buffer);
 		vector->buffer = NULL;
 	}
+	free(vector->density);
+	vector->density = calloc(vector->width * vector->height,
+	    sizeof(float));
+	vector->gain = 1.0;
+	if (vector->density == NULL)
+		return -1;
 	vector->size = (vector->width * vector->height * 3) / 2;
 	vector->buffer = malloc(vector->size);
 	if (vector->buffer == NULL)
@@ -257,6 +466,31 @@ static void gst_vectorscope_set_property(GObject *object, guint prop_id,
 		case ARG_DECAY:
 			vector->decay = g_value_get_float(value);
 			break;
+		case ARG_FRAMERATE:
+			GST_OBJECT_LOCK(vector);
+			vector->framerate = g_value_get_int(value);
+			vector->reconfigure = 1;
+			GST_OBJECT_UNLOCK(vector);
+			break;
+		case ARG_KNEE:
+			vector->knee = g_value_get_float(value);
+			break;
+		case ARG_SPLAT:
+			vector->splat = g_value_get_boolean(value);
+			break;
+		case ARG_MODE:
+			vector->mode = g_value_get_int(value);
+			break;
+		case ARG_SYMBOLRATE:
+			vector->symbolrate = g_value_get_float(value);
+			break;
+		case ARG_OFFSET:
+			/* Move the symbol instants, not the samples */
+			vector->phase += vector->timing -
+			    g_value_get_float(value);
+			vector->phase -= floorf(vector->phase);
+			vector->timing = g_value_get_float(value);
+			break;
 		default:
 			break;
 	}
@@ -274,6 +508,24 @@ static void gst_vectorscope_get_property(GObject *object, guint prop_id,
 		case ARG_DECAY:
 			g_value_set_float(value, vector->decay);
 			break;
+		case ARG_FRAMERATE:
+			g_value_set_int(value, vector->framerate);
+			break;
+		case ARG_KNEE:
+			g_value_set_float(value, vector->knee);
+			break;
+		case ARG_SPLAT:
+			g_value_set_boolean(value, vector->splat);
+			break;
+		case ARG_MODE:
+			g_value_set_int(value, vector->mode);
+			break;
+		case ARG_SYMBOLRATE:
+			g_value_set_float(value, vector->symbolrate);
+			break;
+		case ARG_OFFSET:
+			g_value_set_float(value, vector->timing);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -283,6 +535,13 @@ static void gst_vectorscope_get_property(GObject *object, guint prop_id,
 static GstStateChangeReturn gst_vectorscope_change_state(GstElement *element,
     GstStateChange transition)
 {
+	Gst_vectorscope *vector = GST_VECTORSCOPE(element);
+
+	if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+		vector->time = 0;
+		vector->next = GST_CLOCK_TIME_NONE;
+		iqqos_reset(&vector->qos);
+	}
 	return parent_class->change_state(element, transition);
 }
 
@@ -290,24 +549,40 @@ static gboolean gst_vectorscope_setcaps(GstPad *pad, GstCaps *caps)
 {
 	Gst_vectorscope *vector;
 	GstStructure *structure;
-	GstCaps *newcaps;
 	gboolean ret;
 
 	vector = GST_VECTORSCOPE(gst_pad_get_parent(pad));
 
 	structure = gst_caps_get_structure(caps, 0);
 	gst_structure_get_int(structure, "rate", &vector->rate);
-	vector->framesamples = vector->rate/25;
 
 	gst_vectorscope_setup(vector);
 
-	newcaps = gst_caps_copy(
-	    gst_pad_get_pad_template_caps(vector->srcpad));
-//	structure = gst_caps_get_structure(newcaps, 0);
-//	gst_structure_set(structure, "framerate", G_TYPE_DOUBLE, 
-//	    (double)vector->rate / (double)vector->width, NULL);
-	gst_pad_use_fixed_caps(vector->srcpad);
-	ret = gst_pad_set_caps(vector->srcpad, newcaps);
+	ret = gst_vectorscope_setsrccaps(vector);
+	gst_object_unref(vector);
+	return ret;
+}
+
+static gboolean gst_vectorscope_src_event(GstPad *pad, GstEvent *event)
+{
+	Gst_vectorscope *vector;
+	gboolean ret;
+
+	vector = GST_VECTORSCOPE(gst_pad_get_parent(pad));
+	ret = iqqos_src_event(&vector->qos, GST_ELEMENT(vector), event) ||
+	    gst_pad_event_default(pad, event);
+	gst_object_unref(vector);
+	return ret;
+}
+
+static gboolean gst_vectorscope_sink_event(GstPad *pad, GstEvent *event)
+{
+	Gst_vectorscope *vector;
+	gboolean ret;
+
+	vector = GST_VECTORSCOPE(gst_pad_get_parent(pad));
+	iqqos_sink_event(&vector->qos, GST_ELEMENT(vector), event);
+	ret = gst_pad_event_default(pad, event);
 	gst_object_unref(vector);
 	return ret;
 }
@@ -328,6 +603,30 @@ static void gst_vectorscope_class_init(Gst_vectorscope_class *klass)
 	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_DECAY,
 	    g_param_spec_float("decay", "decay", "decay", 0.0, 1.0, 0.9,
 	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_FRAMERATE,
+	    g_param_spec_int("framerate", "framerate", "frames per second",
+	    1, 1000, 25, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_KNEE,
+	    g_param_spec_float("knee", "knee",
+	    "point density shown at half brightness",
+	    1e-6, G_MAXFLOAT, 0.25, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_SPLAT,
+	    g_param_spec_boolean("splat", "splat",
+	    "spread points over the nearest pixels", FALSE,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_MODE,
+	    g_param_spec_int("mode", "mode",
+	    "0 every sample, 1 constellation, 2 eye diagram",
+	    VECTORSCOPE_RAW, VECTORSCOPE_EYE, VECTORSCOPE_RAW,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_SYMBOLRATE,
+	    g_param_spec_float("symbolrate", "symbolrate",
+	    "symbols per second", 1e-3, G_MAXFLOAT, 1200.0,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_OFFSET,
+	    g_param_spec_float("offset", "offset",
+	    "symbol timing offset in symbols", 0.0, 1.0, 0.0,
+	    G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_vectorscope_change_state;
 }
@@ -344,11 +643,31 @@ static void gst_vectorscope_init(Gst_vectorscope *vector)
 	gst_element_add_pad(GST_ELEMENT(vector), vector->srcpad);
 
 	gst_pad_set_setcaps_function(vector->sinkpad, gst_vectorscope_setcaps);
+	gst_pad_set_event_function(vector->sinkpad, gst_vectorscope_sink_event);
+	gst_pad_set_event_function(vector->srcpad, gst_vectorscope_src_event);
 
 	vector->width = 256;
 	vector->height = 256;
-	vector->samples = 0;
 	vector->buffer = NULL;
+	vector->density = NULL;
+	vector->gain = 1.0;
+	vector->knee = 0.25;
+	vector->splat = FALSE;
+	vector->mode = VECTORSCOPE_RAW;
+	vector->symbolrate = 1200.0;
+	vector->timing = 0.0;
+	vector->phase = 0.0;
+	vector->odd = 0;
+	vector->prev[0] = vector->prev[1] = 0.0;
+	vector->points = NULL;
+	vector->npoints = 0;
+	vector->rate = 0;
+	vector->framerate = 25;
+	vector->interval = GST_SECOND / vector->framerate;
+	vector->reconfigure = 0;
+	vector->time = 0;
+	vector->next = GST_CLOCK_TIME_NONE;
+	iqqos_reset(&vector->qos);
 	vector->offset = 0;
 	vector->decay = 0.9;
 }
@@ -11,6 +11,8 @@
 
 #include "gstiq.h"
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
 
 static GstElementDetails waterfall_details = GST_ELEMENT_DETAILS(
 	"Waterfall plugin",
@@ -35,7 +37,42 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
 
 enum {
 	ARG_0,
-	ARG_MARKER
+	ARG_MARKER,
+	ARG_REFERENCE,
+	ARG_RANGE,
+	ARG_WIDTH,
+	ARG_START,
+	ARG_SPAN,
+	ARG_REDUCE,
+	ARG_FRAMERATE,
+	ARG_PALETTE,
+	ARG_MARKERCONTROL,
+};
+
+enum {
+	WATERFALL_PEAK,
+	WATERFALL_MEAN,
+};
+
+/* Picture formats, in the order of the src template */
+enum {
+	WATERFALL_I420,
+	WATERFALL_BGRX,
+	WATERFALL_RGBX,
+};
+
+enum {
+	WATERFALL_CLASSIC,
+	WATERFALL_GRAY,
+	WATERFALL_HEAT,
+	WATERFALL_RAINBOW,
+};
+
+/* Property changes left for the streaming thread */
+enum {
+	WATERFALL_SETUP = 1,
+	WATERFALL_CAPS = 2,
+	WATERFALL_COLOURS = 4,
 };
 
 static GstPadTemplate *src_template;
@@ -54,7 +91,31 @@ static void gst_waterfall_base_init(Gst_waterfall_class *klass)
 	        "format", GST_TYPE_FOURCC, format,
 		"width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
 		"height", G_TYPE_INT, 128,
-		"framerate", GST_TYPE_FRACTION_RANGE, 1, 1, 50, 1, NULL));
+		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 1000, 1, NULL));
+	/* BGRx */
+	gst_caps_append_structure(capslist,
+	    gst_structure_new("video/x-raw-rgb",
+		"bpp", G_TYPE_INT, 32,
+		"depth", G_TYPE_INT, 24,
+		"endianness", G_TYPE_INT, G_BIG_ENDIAN,
+		"red_mask", G_TYPE_INT, 0x0000ff00,
+		"green_mask", G_TYPE_INT, 0x00ff0000,
+		"blue_mask", G_TYPE_INT, (int)0xff000000,
+		"width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+		"height", G_TYPE_INT, 128,
+		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 1000, 1, NULL));
+	/* RGBx */
+	gst_caps_append_structure(capslist,
+	    gst_structure_new("video/x-raw-rgb",
+		"bpp", G_TYPE_INT, 32,
+		"depth", G_TYPE_INT, 24,
+		"endianness", G_TYPE_INT, G_BIG_ENDIAN,
+		"red_mask", G_TYPE_INT, (int)0xff000000,
+		"green_mask", G_TYPE_INT, 0x00ff0000,
+		"blue_mask", G_TYPE_INT, 0x0000ff00,
+		"width", GST_TYPE_INT_RANGE, 1, G_MAXINT,
+		"height", G_TYPE_INT, 128,
+		"framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 1000, 1, NULL));
 
 	src_template = gst_pad_template_new("src", GST_PAD_SRC,
 	     GST_PAD_ALWAYS, capslist);
@@ -66,105 +127,541 @@ static void gst_waterfall_base_init(Gst_waterfall_class *klass)
 	gst_element_class_set_details(gstelement_class, &waterfall_details);
 }
 
-static GstFlowReturn gst_waterfall_chain(GstPad *pad, GstBuffer *buf)
+/*
+ *	log2 with the exponent taken from the float and a second order fit
+ *	of the mantissa, good to about 0.02 dB. Plain arithmetic, so loops
+ *	using it can be vectorized.
+ */
+static inline float gst_waterfall_log2(float x)
 {
-	Gst_waterfall *waterfall;
-	GstBuffer *outbuf;
-	GstCaps *caps;
+	union { float f; guint32 i; } v;
+	float e, m;
+
+	v.f = x;
+	e = (float)(int)((v.i >> 23) & 0xff) - 128.0;
+	v.i = (v.i & 0x007fffff) | 0x3f800000;
+	m = v.f;
+	return e + (-0.34484843 * m + 2.02466578) * m - 0.67487759;
+}
+
+/*
+ *	Power of 'count' bins in display order, starting at display bin
+ *	'first'. The display starts with the negative frequencies, so
+ *	display bin d is input bin d + n/2 for the first half.
+ */
+static void gst_waterfall_power(const float *in, float *power, int n,
+    int first, int count)
+{
+	int half = n - n / 2;
+	int end = first + count;
+	int d;
+
+	for (d = first; d < end && d < half; d++)
+		power[d - first] = in[(d + n/2)*2] * in[(d + n/2)*2] +
+		    in[(d + n/2)*2+1] * in[(d + n/2)*2+1];
+	for (; d < end; d++)
+		power[d - first] = in[(d - half)*2] * in[(d - half)*2] +
+		    in[(d - half)*2+1] * in[(d - half)*2+1];
+}
+
+/* Reduce 'bins' bins of power to 'columns' columns, peak or mean */
+static void gst_waterfall_reduce(const float *power, float *col,
+    int bins, int columns, int mode)
+{
+	int c, b, b0, b1;
+	float v;
+
+	for (c = 0; c < columns; c++) {
+		b0 = (gint64)c * bins / columns;
+		b1 = (gint64)(c + 1) * bins / columns;
+		if (b1 <= b0)
+			b1 = b0 + 1;
+		v = power[b0];
+		if (mode == WATERFALL_PEAK) {
+			for (b = b0 + 1; b < b1; b++)
+				v = power[b] > v ? power[b] : v;
+		} else {
+			for (b = b0 + 1; b < b1; b++)
+				v += power[b];
+			v /= b1 - b0;
+		}
+		col[c] = v;
+	}
+}
+
+/*
+ *	Level of 'n' columns as 0 to 255: the power in dB, scaled so that
+ *	'reference' dB ends up at 255 and 'range' dB below it at 0.
+ *	The dB scale is folded into a and b by gst_waterfall_levels().
+ */
+static void gst_waterfall_level(const float *power, unsigned char *out,
+    int n, float a, float b)
+{
+	float v;
 	int i;
 
-	waterfall = GST_WATERFALL(gst_pad_get_parent(pad));
+	for (i = 0; i < n; i++) {
+		v = gst_waterfall_log2(power[i]) * a + b;
+		v = v < 0.0 ? 0.0 : v;
+		v = v > 255.0 ? 255.0 : v;
+		out[i] = v;
+	}
+}
+
+/*
+ *	Turn the row of levels into a picture row. RGB rows are a palette
+ *	lookup per pixel, I420 rows hold the luma followed by the chroma
+ *	of every second pixel. The 0 Hz line and the marker are drawn
+ *	over it.
+ */
+static void gst_waterfall_compose(Gst_waterfall *waterfall,
+    unsigned char *row)
+{
+	const unsigned char *level = waterfall->level;
+	unsigned char *u, *v;
+	guint32 *pix;
+	int w = waterfall->columns;
+	int cw = w / 2;
+	int center = waterfall->center;
+	int marker = waterfall->center + waterfall->marker;
+	int i;
 
-	if (++waterfall->fcnt >= waterfall->factor && waterfall->buffer) {
-		unsigned char pix;
-		waterfall->fcnt = 0;
-		memmove(waterfall->buffer, waterfall->buffer+waterfall->length,
-		    waterfall->uoff - waterfall->length);
-		if (waterfall->frame & 1) {
-			memmove(waterfall->buffer + waterfall->uoff,
-		  	  waterfall->buffer + waterfall->uoff + waterfall->length / 2,
-			    (waterfall->uoff/2 - waterfall->length)/ 2);
-			memmove(waterfall->buffer + waterfall->voff,
-			    waterfall->buffer + waterfall->voff + waterfall->length / 2,
-			    (waterfall->uoff/2 - waterfall->length)/ 2);
+	if (center < 0 || center >= cw)
+		center = -1;
+	if (!waterfall->marker || marker < 0 || marker >= cw)
+		marker = -1;
+
+	if (waterfall->format == WATERFALL_I420) {
+		u = row + w;
+		v = row + w + cw;
+		for (i = 0; i < w; i++)
+			row[i] = waterfall->ylut[level[i]];
+		for (i = 0; i < cw; i++) {
+			u[i] = waterfall->ulut[level[i*2+1]];
+			v[i] = waterfall->vlut[level[i*2+1]];
 		}
-		waterfall->frame++;
-		for (i = 0; i < GST_BUFFER_SIZE(buf)/sizeof(float)/2; i++) {
-			pix =
-			    hypot(((float*)GST_BUFFER_DATA(buf))[i*2],
-			    ((float*)GST_BUFFER_DATA(buf))[i*2+1])
-			    * waterfall->length;
-			
-			pix = 46 * log(pix);
-			//pix = 255 - (255 - pix) * (255 - pix) / 255;
-			if (i < GST_BUFFER_SIZE(buf)/sizeof(float)/4) {
-				waterfall->buffer[
-				    waterfall->uoff-waterfall->length/2+i]=
-				    pix;
-			} else {
-				waterfall->buffer[
-				    waterfall->uoff-(waterfall->length*3)/2+i]=
-				    pix;
-			}
+		if (center >= 0) {
+			u[center] = 64;
+			v[center] = 64;
 		}
-		if (waterfall->frame&1) for (i=0; i<waterfall->length/2; i++) {
-			pix = waterfall->buffer[waterfall->uoff-1-i*2]/2;
-			waterfall->buffer[waterfall->voff-1-i]=
-			    128 + (63 - pix) * pix / 16;
-			waterfall->buffer[waterfall->size-1-i]=
-			    128 + pix * pix / 128;
+		if (marker >= 0) {
+			u[marker] = 0;
+			v[marker] = 0;
 		}
-		waterfall->buffer[waterfall->voff-waterfall->length/4] = 64;
-		waterfall->buffer[waterfall->size-waterfall->length/4] = 64;
-		if (waterfall->marker) {
-			waterfall->buffer[waterfall->voff-waterfall->length/4 +
-			    waterfall->marker] = 0;
-			waterfall->buffer[waterfall->size-waterfall->length/4 +
-			    waterfall->marker] = 0;
+	} else {
+		pix = (guint32 *)row;
+		for (i = 0; i < w; i++)
+			pix[i] = waterfall->lut[level[i]];
+		if (center >= 0) {
+			pix[center*2] = waterfall->mark[0];
+			pix[center*2+1] = waterfall->mark[0];
+		}
+		if (marker >= 0) {
+			pix[marker*2] = waterfall->mark[1];
+			pix[marker*2+1] = waterfall->mark[1];
 		}
-		outbuf = gst_buffer_new_and_alloc(waterfall->size);
-		memcpy(GST_BUFFER_DATA(outbuf), waterfall->buffer,
-		    waterfall->size);
-		caps = gst_pad_get_caps(waterfall->srcpad);
-		gst_buffer_set_caps(outbuf, caps);
-		gst_caps_unref(caps);
-		GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
-		GST_BUFFER_OFFSET(outbuf) = waterfall->offset++;
-		gst_pad_push(waterfall->srcpad, outbuf);
 	}
-	gst_buffer_unref(buf);
-	gst_object_unref(waterfall);
-	return GST_FLOW_OK;
 }
 
-static int gst_waterfall_setup(Gst_waterfall *waterfall)
+/*
+ *	The picture is kept as a ring of rows, 'head' is the newest.
+ *	Adding a line only writes that row, the rows are put in order
+ *	when a frame is pushed.
+ */
+static void gst_waterfall_row(Gst_waterfall *waterfall, float *in, int bins)
+{
+	float *power = waterfall->power;
+	int w = waterfall->columns;
+
+	if (bins == waterfall->length) {
+		gst_waterfall_power(in, power, bins,
+		    waterfall->first, waterfall->bins);
+		if (waterfall->bins != w) {
+			gst_waterfall_reduce(power, waterfall->colpower,
+			    waterfall->bins, w, waterfall->reduce);
+			power = waterfall->colpower;
+		}
+		gst_waterfall_level(power, waterfall->level, w,
+		    waterfall->scale, waterfall->bias);
+	}
+	waterfall->head = (waterfall->head + 1) % waterfall->height;
+	gst_waterfall_compose(waterfall,
+	    waterfall->buffer + waterfall->head * waterfall->rowsize);
+}
+
+/* Copy a ring of 'rows' rows to 'out', oldest row first */
+static void gst_waterfall_unroll(unsigned char *out, unsigned char *ring,
+    int rowsize, int rows, int head)
+{
+	int oldest = (head + 1) % rows;
+
+	memcpy(out, ring + oldest * rowsize, (rows - oldest) * rowsize);
+	memcpy(out + (rows - oldest) * rowsize, ring, oldest * rowsize);
+}
+
+static GstBuffer *gst_waterfall_frame(Gst_waterfall *waterfall)
+{
+	GstBuffer *outbuf;
+	unsigned char *out, *u, *v, *row;
+	int w = waterfall->columns;
+	int cw = w / 2;
+	int h = waterfall->height;
+	int r;
+
+	outbuf = gst_buffer_new_and_alloc(waterfall->size);
+	out = GST_BUFFER_DATA(outbuf);
+	if (waterfall->format != WATERFALL_I420) {
+		gst_waterfall_unroll(out, waterfall->buffer,
+		    waterfall->rowsize, h, waterfall->head);
+		return outbuf;
+	}
+	/* Planes: the chroma comes from the second row of each pair */
+	u = out + w * h;
+	v = u + cw * h / 2;
+	for (r = 0; r < h; r++) {
+		row = waterfall->buffer +
+		    ((waterfall->head + 1 + r) % h) * waterfall->rowsize;
+		memcpy(out + r * w, row, w);
+		if (r & 1) {
+			memcpy(u + r / 2 * cw, row + w, cw);
+			memcpy(v + r / 2 * cw, row + w + cw, cw);
+		}
+	}
+	return outbuf;
+}
+
+/*
+ *	Marker position in chroma pixels from the 0 Hz column.
+ *	'marker' Hz is markerf/rate*length bins.
+ */
+static void gst_waterfall_marker(Gst_waterfall *waterfall)
+{
+	if (!waterfall->rate || !waterfall->bins)
+		return;
+	waterfall->marker = 0.5 +
+	    waterfall->markerf / (float)waterfall->rate *
+	    waterfall->length * waterfall->columns / waterfall->bins / 2;
+	waterfall->marker %= waterfall->columns;
+}
+
+/*
+ *	A row is added every 'interval' of stream time. A jump in the
+ *	timestamps (seek, gap) restarts the pacing instead of catching
+ *	up with a burst of rows.
+ */
+static gboolean gst_waterfall_due(Gst_waterfall *waterfall, GstClockTime ts)
+{
+	if (!GST_CLOCK_TIME_IS_VALID(waterfall->next) ||
+	    ts + waterfall->interval < waterfall->next ||
+	    ts > waterfall->next + waterfall->interval)
+		waterfall->next = ts;
+	if (ts < waterfall->next)
+		return FALSE;
+	waterfall->next += waterfall->interval;
+	return TRUE;
+}
+
+/*
+ *	Bins are normalized to 1/length, 20*log10(length) brings a full
+ *	scale sine back to 0 dB. 10*log10(x) = 3.0103 * log2(x).
+ */
+static void gst_waterfall_levels(Gst_waterfall *waterfall)
+{
+	waterfall->scale = 10.0 * M_LN2 / M_LN10 * 255.0 / waterfall->range;
+	waterfall->bias = (20.0 * log10(waterfall->length) -
+	    waterfall->reference + waterfall->range) * 255.0 /
+	    waterfall->range;
+}
+
+static void gst_waterfall_yuv2rgb(int y, int u, int v, int *rgb)
 {
 	int i;
 
+	rgb[0] = y + 1.402 * (v - 128);
+	rgb[1] = y - 0.344136 * (u - 128) - 0.714136 * (v - 128);
+	rgb[2] = y + 1.772 * (u - 128);
+	for (i = 0; i < 3; i++)
+		rgb[i] = rgb[i] < 0 ? 0 : rgb[i] > 255 ? 255 : rgb[i];
+}
+
+/* A pixel for the RGB ring, in memory order */
+static guint32 gst_waterfall_pixel(Gst_waterfall *waterfall, int *rgb)
+{
+	union { guint32 i; unsigned char c[4]; } pix;
+
+	if (waterfall->format == WATERFALL_RGBX) {
+		pix.c[0] = rgb[0];
+		pix.c[2] = rgb[2];
+	} else {
+		pix.c[0] = rgb[2];
+		pix.c[2] = rgb[0];
+	}
+	pix.c[1] = rgb[1];
+	pix.c[3] = 0;
+	return pix.i;
+}
+
+static int gst_waterfall_clamp(int x)
+{
+	return x < 0 ? 0 : x > 255 ? 255 : x;
+}
+
+/*
+ *	Level to colour lookup tables. The classic palette is the original
+ *	YUV formula, the others are defined in RGB.
+ */
+static void gst_waterfall_palette(Gst_waterfall *waterfall)
+{
+	int rgb[3];
+	int i, t, pix;
+
+	for (i = 0; i < 256; i++) {
+		switch (waterfall->palette) {
+			case WATERFALL_GRAY:
+				rgb[0] = rgb[1] = rgb[2] = i;
+				break;
+			case WATERFALL_HEAT:
+				rgb[0] = gst_waterfall_clamp(i * 3);
+				rgb[1] = gst_waterfall_clamp(i * 3 - 255);
+				rgb[2] = gst_waterfall_clamp(i * 3 - 510);
+				break;
+			case WATERFALL_RAINBOW:
+				t = i * 4;
+				rgb[0] = gst_waterfall_clamp(384 - abs(t - 765));
+				rgb[1] = gst_waterfall_clamp(384 - abs(t - 510));
+				rgb[2] = gst_waterfall_clamp(384 - abs(t - 255));
+				break;
+			case WATERFALL_CLASSIC:
+			default:
+				pix = i / 2;
+				waterfall->ylut[i] = i;
+				waterfall->ulut[i] = 128 + (63 - pix) * pix / 16;
+				waterfall->vlut[i] = 128 + pix * pix / 128;
+				gst_waterfall_yuv2rgb(i, waterfall->ulut[i],
+				    waterfall->vlut[i], rgb);
+				waterfall->lut[i] =
+				    gst_waterfall_pixel(waterfall, rgb);
+				continue;
+		}
+		waterfall->lut[i] = gst_waterfall_pixel(waterfall, rgb);
+		waterfall->ylut[i] = gst_waterfall_clamp(
+		    0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2]);
+		waterfall->ulut[i] = gst_waterfall_clamp(128 +
+		    -0.168736 * rgb[0] - 0.331264 * rgb[1] + 0.5 * rgb[2]);
+		waterfall->vlut[i] = gst_waterfall_clamp(128 +
+		    0.5 * rgb[0] - 0.418688 * rgb[1] - 0.081312 * rgb[2]);
+	}
+	/* The 0 Hz line and the marker, as in the I420 picture */
+	gst_waterfall_yuv2rgb(128, 64, 64, rgb);
+	waterfall->mark[0] = gst_waterfall_pixel(waterfall, rgb);
+	gst_waterfall_yuv2rgb(128, 0, 0, rgb);
+	waterfall->mark[1] = gst_waterfall_pixel(waterfall, rgb);
+}
+
+/* Pick the picture format downstream likes best */
+static void gst_waterfall_format(Gst_waterfall *waterfall)
+{
+	GstStructure *structure;
+	GstCaps *caps;
+	int mask;
+
+	waterfall->format = WATERFALL_I420;
+	caps = gst_pad_get_allowed_caps(waterfall->srcpad);
+	if (!caps)
+		return;
+	if (!gst_caps_is_empty(caps)) {
+		structure = gst_caps_get_structure(caps, 0);
+		if (gst_structure_has_name(structure, "video/x-raw-rgb")) {
+			waterfall->format = WATERFALL_BGRX;
+			if (gst_structure_get_int(structure, "red_mask",
+			    &mask) && mask == (int)0xff000000)
+				waterfall->format = WATERFALL_RGBX;
+		}
+	}
+	gst_caps_unref(caps);
+}
+
+static int gst_waterfall_setup(Gst_waterfall *waterfall)
+{
+	int n = waterfall->length;
+	int w, i;
+
 	if (waterfall->buffer) {
 		free(waterfall->buffer);
 		waterfall->buffer = NULL;
 	}
-	waterfall->size = (waterfall->length * waterfall->height * 3) / 2;
-	waterfall->buffer = malloc(waterfall->size);
+	free(waterfall->power);
+	free(waterfall->colpower);
+	free(waterfall->level);
+
+	/* Displayed part of the spectrum */
+	waterfall->first = waterfall->start < n ? waterfall->start : n - 1;
+	waterfall->bins = n - waterfall->first;
+	if (waterfall->span && waterfall->span < waterfall->bins)
+		waterfall->bins = waterfall->span;
+	w = waterfall->width ? waterfall->width : waterfall->bins;
+	w &= ~3;
+	if (w < 4)
+		w = 4;
+	waterfall->columns = w;
+	/* 0 Hz is display bin n - n/2 */
+	waterfall->center = (gint64)(n - n/2 - waterfall->first) * w /
+	    waterfall->bins / 2;
+	gst_waterfall_marker(waterfall);
+
+	waterfall->power = malloc(sizeof(float) * waterfall->bins);
+	waterfall->colpower = malloc(sizeof(float) * w);
+	waterfall->level = calloc(w, 1);
+	if (waterfall->format == WATERFALL_I420) {
+		waterfall->rowsize = w * 2;
+		waterfall->size = (w * waterfall->height * 3) / 2;
+	} else {
+		waterfall->rowsize = w * 4;
+		waterfall->size = w * waterfall->height * 4;
+	}
+	waterfall->buffer = malloc(waterfall->rowsize * waterfall->height);
 	if (waterfall->buffer == NULL)
 		return -1;
-	waterfall->uoff = waterfall->length * waterfall->height;
-	memset(waterfall->buffer, 0, waterfall->uoff);
-	waterfall->voff = (waterfall->uoff * 5) / 4;
-	memset(waterfall->buffer + waterfall->uoff, 128, waterfall->uoff / 2);
-	for (i = 0; i < waterfall->height; i++) {
-		waterfall->buffer[waterfall->length*i +waterfall->length/2] =0;
-		waterfall->buffer[waterfall->length/2*i/2 + waterfall->uoff]=64;
-		waterfall->buffer[waterfall->length/2*i/2 + waterfall->voff]=64;
-	}
-	waterfall->marker = 0.5 +
-	    waterfall->markerf / (float)waterfall->rate *
-	    waterfall->length / 2;
-	waterfall->marker %= waterfall->length;
+	gst_waterfall_palette(waterfall);
+	gst_waterfall_levels(waterfall);
+	/* Start with an empty picture */
+	for (i = 0; i < waterfall->height; i++)
+		gst_waterfall_compose(waterfall,
+		    waterfall->buffer + i * waterfall->rowsize);
+	/* The last row is the newest */
+	waterfall->head = waterfall->height - 1;
 	return 0;
 }
 
+/*
+ *	Frames are pushed at 'framerate', or once per spectrum when the
+ *	spectra come slower than that.
+ */
+static gboolean gst_waterfall_setsrccaps(Gst_waterfall *waterfall)
+{
+	GstStructure *structure;
+	GstCaps *newcaps;
+	gboolean ret;
+
+	waterfall->interval = GST_SECOND / waterfall->framerate;
+	newcaps = gst_caps_copy_nth(
+	    gst_pad_get_pad_template_caps(waterfall->srcpad),
+	    waterfall->format);
+	structure = gst_caps_get_structure(newcaps, 0);
+	if (waterfall->rate < waterfall->length * waterfall->framerate)
+		gst_structure_set(structure, "framerate", GST_TYPE_FRACTION,
+		    waterfall->rate, waterfall->length, NULL);
+	else
+		gst_structure_set(structure, "framerate", GST_TYPE_FRACTION,
+		    waterfall->framerate, 1, NULL);
+	gst_structure_set(structure, "width", G_TYPE_INT, waterfall->columns,
+	    NULL);
+	gst_pad_use_fixed_caps(waterfall->srcpad);
+	ret = gst_pad_set_caps(waterfall->srcpad, newcaps);
+	gst_caps_unref(newcaps);
+	return ret;
+}
+
+/* (Re)build the picture and tell downstream about its new size */
+static gboolean gst_waterfall_configure(Gst_waterfall *waterfall)
+{
+	gst_waterfall_format(waterfall);
+	if (gst_waterfall_setup(waterfall))
+		return FALSE;
+	return gst_waterfall_setsrccaps(waterfall);
+}
+
+static GstFlowReturn gst_waterfall_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_waterfall *waterfall;
+	GstBuffer *outbuf;
+	GstCaps *caps;
+	GstClockTime ts;
+	float value;
+	int reconfigure;
+
+	waterfall = GST_WATERFALL(gst_pad_get_parent(pad));
+
+	GST_OBJECT_LOCK(waterfall);
+	if (waterfall->markercontrol && iqcontrol_read(
+	    waterfall->markercontrol, &value, &waterfall->markerseq)) {
+		waterfall->markerf = value;
+		gst_waterfall_marker(waterfall);
+	}
+	reconfigure = waterfall->reconfigure;
+	waterfall->reconfigure = 0;
+	GST_OBJECT_UNLOCK(waterfall);
+
+	/*
+	 *	The rows are only touched from here, the picture is rebuilt
+	 *	here too instead of under the feet of a running chain.
+	 */
+	if (waterfall->rate) {
+		if (reconfigure & WATERFALL_SETUP)
+			gst_waterfall_configure(waterfall);
+		else if (reconfigure & WATERFALL_CAPS)
+			gst_waterfall_setsrccaps(waterfall);
+		if ((reconfigure & WATERFALL_COLOURS) && waterfall->buffer) {
+			gst_waterfall_palette(waterfall);
+			gst_waterfall_levels(waterfall);
+		}
+	}
+
+	/* Without timestamps count the stream time ourselves */
+	ts = GST_BUFFER_TIMESTAMP(buf);
+	if (!GST_CLOCK_TIME_IS_VALID(ts))
+		ts = waterfall->time;
+	if (waterfall->rate)
+		waterfall->time = ts + gst_util_uint64_scale_int(GST_SECOND,
+		    waterfall->length, waterfall->rate);
+
+	if (!waterfall->buffer || !gst_waterfall_due(waterfall, ts))
+		goto out;
+	gst_waterfall_row(waterfall, (float *)GST_BUFFER_DATA(buf),
+	    GST_BUFFER_SIZE(buf)/sizeof(float)/2);
+	/* Nobody to show it to, only the row is kept */
+	if (!gst_pad_is_linked(waterfall->srcpad))
+		goto out;
+	/* The sink would drop it, don't bother building it */
+	if (iqqos_late(&waterfall->qos, GST_ELEMENT(waterfall), ts))
+		goto out;
+	outbuf = gst_waterfall_frame(waterfall);
+	caps = gst_pad_get_caps(waterfall->srcpad);
+	gst_buffer_set_caps(outbuf, caps);
+	gst_caps_unref(caps);
+	GST_BUFFER_TIMESTAMP(outbuf) = ts;
+	GST_BUFFER_OFFSET(outbuf) = waterfall->offset++;
+	gst_pad_push(waterfall->srcpad, outbuf);
+out:
+	gst_buffer_unref(buf);
+	gst_object_unref(waterfall);
+	return GST_FLOW_OK;
+}
+
+static gboolean gst_waterfall_src_event(GstPad *pad, GstEvent *event)
+{
+	Gst_waterfall *waterfall;
+	gboolean ret;
+
+	waterfall = GST_WATERFALL(gst_pad_get_parent(pad));
+	ret = iqqos_src_event(&waterfall->qos, GST_ELEMENT(waterfall), event) ||
+	    gst_pad_event_default(pad, event);
+	gst_object_unref(waterfall);
+	return ret;
+}
+
+static gboolean gst_waterfall_sink_event(GstPad *pad, GstEvent *event)
+{
+	Gst_waterfall *waterfall;
+	gboolean ret;
+
+	waterfall = GST_WATERFALL(gst_pad_get_parent(pad));
+	iqqos_sink_event(&waterfall->qos, GST_ELEMENT(waterfall), event);
+	ret = gst_pad_event_default(pad, event);
+	gst_object_unref(waterfall);
+	return ret;
+}
+
 static void gst_waterfall_set_property(GObject *object, guint prop_id,
     const GValue *value, GParamSpec *pspec)
 {
@@ -176,10 +673,64 @@ static void gst_waterfall_set_property(GObject *object, guint prop_id,
 	switch(prop_id) {
 		case ARG_MARKER:
 			waterfall->markerf = g_value_get_float(value);
-			waterfall->marker = 0.5 +
-			    waterfall->markerf / (float)waterfall->rate *
-			    waterfall->length / 2;
-			waterfall->marker %= waterfall->length;
+			gst_waterfall_marker(waterfall);
+			break;
+		case ARG_WIDTH:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->width = g_value_get_int(value);
+			waterfall->reconfigure |= WATERFALL_SETUP;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_START:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->start = g_value_get_int(value);
+			waterfall->reconfigure |= WATERFALL_SETUP;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_SPAN:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->span = g_value_get_int(value);
+			waterfall->reconfigure |= WATERFALL_SETUP;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_REDUCE:
+			waterfall->reduce = g_value_get_int(value);
+			break;
+		case ARG_FRAMERATE:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->framerate = g_value_get_int(value);
+			waterfall->reconfigure |= WATERFALL_CAPS;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_MARKERCONTROL:
+			GST_OBJECT_LOCK(waterfall);
+			iqcontrol_put(waterfall->markercontrol);
+			g_free(waterfall->markername);
+			waterfall->markername =
+			    g_strdup(g_value_get_string(value));
+			waterfall->markercontrol =
+			    iqcontrol_get(waterfall->markername);
+			waterfall->markerseq = 0;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_PALETTE:
+			/* Only new rows get the new colours */
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->palette = g_value_get_int(value);
+			waterfall->reconfigure |= WATERFALL_COLOURS;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_REFERENCE:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->reference = g_value_get_float(value);
+			waterfall->reconfigure |= WATERFALL_COLOURS;
+			GST_OBJECT_UNLOCK(waterfall);
+			break;
+		case ARG_RANGE:
+			GST_OBJECT_LOCK(waterfall);
+			waterfall->range = g_value_get_float(value);
+			waterfall->reconfigure |= WATERFALL_COLOURS;
+			GST_OBJECT_UNLOCK(waterfall);
 			break;
 		default:
 			break;
@@ -198,6 +749,33 @@ static void gst_waterfall_get_property(GObject *object, guint prop_id,
 		case ARG_MARKER:
 			g_value_set_float(value, waterfall->markerf);
 			break;
+		case ARG_REFERENCE:
+			g_value_set_float(value, waterfall->reference);
+			break;
+		case ARG_RANGE:
+			g_value_set_float(value, waterfall->range);
+			break;
+		case ARG_WIDTH:
+			g_value_set_int(value, waterfall->width);
+			break;
+		case ARG_START:
+			g_value_set_int(value, waterfall->start);
+			break;
+		case ARG_SPAN:
+			g_value_set_int(value, waterfall->span);
+			break;
+		case ARG_REDUCE:
+			g_value_set_int(value, waterfall->reduce);
+			break;
+		case ARG_FRAMERATE:
+			g_value_set_int(value, waterfall->framerate);
+			break;
+		case ARG_PALETTE:
+			g_value_set_int(value, waterfall->palette);
+			break;
+		case ARG_MARKERCONTROL:
+			g_value_set_string(value, waterfall->markername);
+			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
 			break;
@@ -207,6 +785,13 @@ static void gst_waterfall_get_property(GObject *object, guint prop_id,
 static GstStateChangeReturn gst_waterfall_change_state(GstElement *element,
     GstStateChange transition)
 {
+	Gst_waterfall *waterfall = GST_WATERFALL(element);
+
+	if (transition == GST_STATE_CHANGE_READY_TO_PAUSED) {
+		waterfall->time = 0;
+		waterfall->next = GST_CLOCK_TIME_NONE;
+		iqqos_reset(&waterfall->qos);
+	}
 	return parent_class->change_state(element, transition);
 }
 
@@ -214,7 +799,6 @@ static gboolean gst_waterfall_setcaps(GstPad *pad, GstCaps *caps)
 {
 	Gst_waterfall *waterfall;
 	GstStructure *structure;
-	GstCaps *newcaps;
 	gboolean ret;
 
 	waterfall = GST_WATERFALL(gst_pad_get_parent(pad));
@@ -223,28 +807,12 @@ static gboolean gst_waterfall_setcaps(GstPad *pad, GstCaps *caps)
 	gst_structure_get_int(structure, "rate", &waterfall->rate);
 	gst_structure_get_int(structure, "length", &waterfall->length);
 
-	if (waterfall->length & 3)
+	if (waterfall->length & 3) {
+		gst_object_unref(waterfall);
 		return FALSE;
-
-	waterfall->factor = 1;
-	if (waterfall->rate / waterfall->length >= 10) {
-		while ((float)waterfall->rate/(float)waterfall->length/
-		    (float)waterfall->factor > 50.0)
-			waterfall->factor++;
 	}
-	waterfall->fcnt = 0;
-
-	gst_waterfall_setup(waterfall);
 
-	newcaps = gst_caps_copy(
-	    gst_pad_get_pad_template_caps(waterfall->srcpad));
-	structure = gst_caps_get_structure(newcaps, 0);
-	gst_structure_set(structure, "framerate", GST_TYPE_FRACTION, 
-	    waterfall->rate, waterfall->length * waterfall->factor, NULL);
-	gst_structure_set(structure, "width", G_TYPE_INT, waterfall->length,
-	    NULL);
-	gst_pad_use_fixed_caps(waterfall->srcpad);
-	ret = gst_pad_set_caps(waterfall->srcpad, newcaps);
+	ret = gst_waterfall_configure(waterfall);
 	gst_object_unref(waterfall);
 
 	return ret;
@@ -268,6 +836,44 @@ static void gst_waterfall_class_init(Gst_waterfall_class *klass)
 
 	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_MARKER,
 	    g_param_spec_float("marker", "marker", "marker", -G_MAXFLOAT, G_MAXFLOAT, 0.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_REFERENCE,
+	    g_param_spec_float("reference", "reference",
+	    "level in dB shown at full brightness",
+	    -G_MAXFLOAT, G_MAXFLOAT, 48.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_RANGE,
+	    g_param_spec_float("range", "range",
+	    "dB below the reference level shown as black",
+	    1.0, G_MAXFLOAT, 48.0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_WIDTH,
+	    g_param_spec_int("width", "width",
+	    "picture width, 0 for one column per bin",
+	    0, G_MAXINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_START,
+	    g_param_spec_int("start", "start",
+	    "first bin shown, 0 is the lowest negative frequency",
+	    0, G_MAXINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_SPAN,
+	    g_param_spec_int("span", "span",
+	    "number of bins shown, 0 for all from start",
+	    0, G_MAXINT, 0, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_REDUCE,
+	    g_param_spec_int("reduce", "reduce",
+	    "bins to column: 0 peak, 1 mean",
+	    WATERFALL_PEAK, WATERFALL_MEAN, WATERFALL_PEAK,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_FRAMERATE,
+	    g_param_spec_int("framerate", "framerate",
+	    "frames per second", 1, 1000, 25, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass), ARG_PALETTE,
+	    g_param_spec_int("palette", "palette",
+	    "0 classic, 1 gray, 2 heat, 3 rainbow",
+	    WATERFALL_CLASSIC, WATERFALL_RAINBOW, WATERFALL_CLASSIC,
+	    G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS (klass),
+	    ARG_MARKERCONTROL,
+	    g_param_spec_string("marker-control", "marker-control",
+	    "name of a control value to take the marker from", NULL,
+	    G_PARAM_READWRITE));
 
 	gstelement_class->change_state = gst_waterfall_change_state;
 }
@@ -284,13 +890,34 @@ static void gst_waterfall_init(Gst_waterfall *waterfall)
 	gst_element_add_pad(GST_ELEMENT(waterfall), waterfall->srcpad);
 
 	gst_pad_set_setcaps_function(waterfall->sinkpad, gst_waterfall_setcaps);
+	gst_pad_set_event_function(waterfall->sinkpad, gst_waterfall_sink_event);
+	gst_pad_set_event_function(waterfall->srcpad, gst_waterfall_src_event);
 //	gst_pad_set_setcaps_function(waterfall->srcpad, gst_waterfall_setcaps);
 
 	waterfall->length = 1024;
 	waterfall->height = 128;
-	waterfall->frame = 0;
 	waterfall->buffer = NULL;
 	waterfall->offset = 0;
+	waterfall->reference = 48.0;
+	waterfall->range = 48.0;
+	waterfall->width = 0;
+	waterfall->start = 0;
+	waterfall->span = 0;
+	waterfall->reduce = WATERFALL_PEAK;
+	waterfall->power = NULL;
+	waterfall->colpower = NULL;
+	waterfall->level = NULL;
+	waterfall->format = WATERFALL_I420;
+	waterfall->palette = WATERFALL_CLASSIC;
+	waterfall->markername = NULL;
+	waterfall->markercontrol = NULL;
+	waterfall->markerseq = 0;
+	waterfall->rate = 0;
+	waterfall->framerate = 25;
+	waterfall->reconfigure = 0;
+	waterfall->time = 0;
+	waterfall->next = GST_CLOCK_TIME_NONE;
+	iqqos_reset(&waterfall->qos);
 }
 
 GType gst_waterfall_get_type(void)
@@ -0,0 +1,596 @@
+/*
+ *	Wideband FM stereo and RDS decoder.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Input is the discriminator output of a broadcast station (iqfmdem
+ *	with the deviation set to 75 kHz, so full deviation is 1.0). The
+ *	multiplex is:
+ *
+ *	    0.9 * ((L+R)/2 + (L-R)/2 sin(2wt)) + 0.1 sin(wt) + rds sin(3wt)
+ *
+ *	with the 19 kHz pilot at w. A PLL locks to the pilot, its phase
+ *	gives the 38 kHz and 57 kHz carriers without extra oscillators.
+ *	The pilot is subtracted from the multiplex once it is known.
+ *
+ *	Everything runs at the lowest rate it can:
+ *	- The multiplex is halved by half-band stages while it stays
+ *	  above twice the highest frequency needed (53 kHz, or 60 kHz
+ *	  with RDS). The PLL and the mixing run at that rate.
+ *	- The sum and difference signals are halved down to 38-76 kHz,
+ *	  then a 15 kHz low-pass, the matrix and de-emphasis give L and R.
+ *	- RDS is mixed to complex baseband and halved down to 12-24 kHz.
+ *	  It goes out on the 'rds' pad as audio/x-complex-float.
+ *	Without pilot the output is mono.
+ */
+
+#include <math.h>
+#include "gstiq.h"
+#include <string.h>
+#include <stdlib.h>
+
+static GstElementDetails iqwfmstereo_details = GST_ELEMENT_DETAILS(
+	"Wideband FM stereo decoder",
+	"Filter/Effect/Audio",
+	"Decodes the stereo multiplex and RDS of a broadcast FM station",
+	"agent (agent@local)"
+);
+
+enum {
+	ARG_0,
+	ARG_STEREO,
+	ARG_RDS,
+	ARG_DEEMPHASIS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+	"sink",
+	GST_PAD_SINK,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"rate = (int) [ 106000, MAX ], "
+		"buffer-frames = (int) [ 0, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-raw-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 32, "
+		"width = (int) 32, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 2"
+	)
+);
+
+static GstStaticPadTemplate rds_template = GST_STATIC_PAD_TEMPLATE(
+	"rds",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS(
+		"audio/x-complex-float, "
+		"endianness = (int) BYTE_ORDER, "
+		"depth = (int) 64, "
+		"width = (int) 64, "
+		"rate = (int) [ 1, MAX ], "
+		"channels = (int) 1"
+	)
+);
+
+#define WFM_PILOT	19000.0
+#define WFM_LOOPBW	20.0	/* PLL noise bandwidth in Hz */
+#define WFM_ERRBW	500.0	/* phase detector low-pass in Hz */
+#define WFM_PILOTBW	5.0	/* pilot amplitude low-pass in Hz */
+#define WFM_PULLIN	100.0	/* Hz */
+#define WFM_LOCK	0.01	/* pilot amplitude/2, nominal is 0.05 */
+
+/* Half-band stages are clean up to 0.2 of their input rate */
+#define WFM_HBPASS	0.2
+
+#define WFM_SINBITS	10
+#define WFM_SINSIZE	(1 << WFM_SINBITS)
+
+static float wfm_sin[WFM_SINSIZE];
+/* Odd taps of the half-band filter from the center out, the center is 0.5 */
+static float wfm_hb[(WFM_HBTAPS + 1) / 4];
+
+static GstElementClass *parent_class = NULL;
+
+static float gst_iqwfmstereo_blackman(int n, int taps)
+{
+	return 0.42 - 0.5 * cos(2.0 * M_PI * n / (taps - 1)) +
+	    0.08 * cos(4.0 * M_PI * n / (taps - 1));
+}
+
+static void gst_iqwfmstereo_tables(void)
+{
+	int i, d, m = (WFM_HBTAPS - 1) / 2;
+	float sum = 0.0;
+
+	for (i = 0; i < WFM_SINSIZE; i++)
+		wfm_sin[i] = sin(2.0 * M_PI * i / WFM_SINSIZE);
+	for (i = 0; i < (WFM_HBTAPS + 1) / 4; i++) {
+		d = i * 2 + 1;
+		wfm_hb[i] = sin(M_PI * d / 2.0) / (M_PI * d) *
+		    gst_iqwfmstereo_blackman(m + d, WFM_HBTAPS);
+		sum += wfm_hb[i];
+	}
+	/* Unity gain: the center and both sides add up to 1 */
+	for (i = 0; i < (WFM_HBTAPS + 1) / 4; i++)
+		wfm_hb[i] *= 0.25 / sum;
+}
+
+/* Halves the rate of 'n' samples in place, returns the samples left */
+static int gst_iqwfmstereo_halfband(struct wfmhalfband *hb, float *buf, int n)
+{
+	const int m = (WFM_HBTAPS - 1) / 2;
+	float *w, y;
+	int i, k, o;
+
+	for (i = 0, o = 0; i < n; i++) {
+		hb->hist[hb->pos] = hb->hist[hb->pos + WFM_HBTAPS] = buf[i];
+		if (++hb->pos == WFM_HBTAPS)
+			hb->pos = 0;
+		hb->odd ^= 1;
+		if (hb->odd)
+			continue;
+		w = hb->hist + hb->pos + m;
+		y = 0.5 * w[0];
+		for (k = 0; k < (WFM_HBTAPS + 1) / 4; k++)
+			y += wfm_hb[k] * (w[-(k*2+1)] + w[k*2+1]);
+		buf[o++] = y;
+	}
+	return o;
+}
+
+/* Symmetric FIR filter, one output per input */
+static float gst_iqwfmstereo_fir(const float *coef, int taps, float *hist,
+    int pos)
+{
+	const float *w = hist + pos + taps / 2;
+	float y = coef[taps / 2] * w[0];
+	int d;
+
+	for (d = 1; d <= taps / 2; d++)
+		y += coef[taps / 2 - d] * (w[-d] + w[d]);
+	return y;
+}
+
+/* Pilot PLL and mixing at the multiplex rate */
+static void gst_iqwfmstereo_mix(Gst_iqwfmstereo *wfm, const float *mpx,
+    float *sum, float *diff, float *rdsi, float *rdsq, int n)
+{
+	float x, s, c, e, amp, err, errlen;
+	int i;
+	guint32 idx;
+
+	for (i = 0; i < n; i++) {
+		idx = wfm->phase >> (32 - WFM_SINBITS);
+		s = wfm_sin[idx];
+		c = wfm_sin[(idx + WFM_SINSIZE / 4) & (WFM_SINSIZE - 1)];
+		x = mpx[i];
+
+		/* Phase detector, err is amp * sin(phase error) */
+		wfm->err += (x * c - wfm->err) * wfm->erralpha;
+		wfm->amp += (x * s - wfm->amp) * wfm->erralpha;
+		err = wfm->err;
+		amp = wfm->amp;
+		errlen = sqrtf(err * err + amp * amp) + 1e-9;
+		e = err / errlen;
+		wfm->integ += wfm->ki * e;
+		if (wfm->integ > wfm->pullin)
+			wfm->integ = wfm->pullin;
+		if (wfm->integ < -wfm->pullin)
+			wfm->integ = -wfm->pullin;
+		wfm->phase += wfm->step + (gint32)(wfm->integ + wfm->kp * e);
+
+		/* Without the pilot, its amplitude averaged much longer */
+		wfm->pilot += (amp - wfm->pilot) * wfm->pilotalpha;
+		x -= 2.0 * wfm->pilot * s;
+		sum[i] = x;
+		diff[i] = 4.0 * x * s * c;
+		if (rdsi) {
+			rdsi[i] = 2.0 * x * c * (4.0 * c * c - 3.0);
+			rdsq[i] = -2.0 * x * s * (3.0 - 4.0 * s * s);
+		}
+	}
+}
+
+static GstFlowReturn gst_iqwfmstereo_chain(GstPad *pad, GstBuffer *buf)
+{
+	Gst_iqwfmstereo *wfm;
+	GstBuffer *outbuf;
+	GstCaps *caps;
+	float *mpx, *sum, *diff, *rdsi, *rdsq, *out, *s, *d;
+	float l, r, target;
+	int i, k, n, rds, taps;
+
+	wfm = GST_IQWFMSTEREO(gst_pad_get_parent(pad));
+	if (!wfm->fircoef) {
+		gst_buffer_unref(buf);
+		gst_object_unref(wfm);
+		return GST_FLOW_NOT_NEGOTIATED;
+	}
+
+	n = GST_BUFFER_SIZE(buf) / sizeof(float);
+	if (n > wfm->worksize) {
+		free(wfm->work);
+		wfm->work = malloc(sizeof(float) * n * 5);
+		wfm->worksize = wfm->work ? n : 0;
+		if (!wfm->work) {
+			gst_buffer_unref(buf);
+			gst_object_unref(wfm);
+			return GST_FLOW_ERROR;
+		}
+	}
+	mpx = wfm->work;
+	sum = mpx + n;
+	diff = sum + n;
+	rdsi = diff + n;
+	rdsq = rdsi + n;
+	rds = wfm->rds && gst_pad_is_linked(wfm->rdspad);
+
+	memcpy(mpx, GST_BUFFER_DATA(buf), sizeof(float) * n);
+	for (k = 0; k < wfm->mpxstages; k++)
+		n = gst_iqwfmstereo_halfband(&wfm->mpxhb[k], mpx, n);
+
+	gst_iqwfmstereo_mix(wfm, mpx, sum, diff,
+	    rds ? rdsi : NULL, rds ? rdsq : NULL, n);
+
+	/* Fade between mono and stereo with the pilot lock */
+	target = wfm->stereo && fabsf(wfm->err) * 2.0 < wfm->amp &&
+	    wfm->amp > WFM_LOCK ? 1.0 : 0.0;
+
+	if (rds) {
+		int nr = n;
+
+		for (k = 0; k < wfm->rdsstages; k++) {
+			gst_iqwfmstereo_halfband(&wfm->rdsihb[k], rdsi, nr);
+			nr = gst_iqwfmstereo_halfband(&wfm->rdsqhb[k], rdsq, nr);
+		}
+		outbuf = gst_buffer_new_and_alloc(sizeof(float) * 2 * nr);
+		out = (float *)GST_BUFFER_DATA(outbuf);
+		for (i = 0; i < nr; i++) {
+			out[i*2] = rdsi[i];
+			out[i*2+1] = rdsq[i];
+		}
+		GST_BUFFER_OFFSET(outbuf) = wfm->rdsoffset;
+		GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
+		wfm->rdsoffset += nr;
+		caps = gst_pad_get_caps(wfm->rdspad);
+		gst_buffer_set_caps(outbuf, caps);
+		gst_caps_unref(caps);
+		gst_pad_push(wfm->rdspad, outbuf);
+	}
+
+	for (k = 0; k < wfm->audiostages; k++) {
+		gst_iqwfmstereo_halfband(&wfm->sumhb[k], sum, n);
+		n = gst_iqwfmstereo_halfband(&wfm->diffhb[k], diff, n);
+	}
+
+	outbuf = gst_buffer_new_and_alloc(sizeof(float) * 2 * n);
+	out = (float *)GST_BUFFER_DATA(outbuf);
+	taps = wfm->firtaps;
+	s = wfm->sumhist;
+	d = wfm->diffhist;
+	for (i = 0; i < n; i++) {
+		s[wfm->firpos] = s[wfm->firpos + taps] = sum[i];
+		d[wfm->firpos] = d[wfm->firpos + taps] = diff[i];
+		if (++wfm->firpos == taps)
+			wfm->firpos = 0;
+		wfm->blend += (target - wfm->blend) * wfm->blendalpha;
+		l = gst_iqwfmstereo_fir(wfm->fircoef, taps, s, wfm->firpos);
+		r = gst_iqwfmstereo_fir(wfm->fircoef, taps, d, wfm->firpos) *
+		    wfm->blend;
+		wfm->left += (l + r - wfm->left) * wfm->dealpha;
+		wfm->right += (l - r - wfm->right) * wfm->dealpha;
+		out[i*2] = wfm->left;
+		out[i*2+1] = wfm->right;
+	}
+	GST_BUFFER_OFFSET(outbuf) = wfm->offset;
+	GST_BUFFER_TIMESTAMP(outbuf) = GST_BUFFER_TIMESTAMP(buf);
+	wfm->offset += n;
+
+	caps = gst_pad_get_caps(wfm->srcpad);
+	gst_buffer_set_caps(outbuf, caps);
+	gst_caps_unref(caps);
+	gst_buffer_unref(buf);
+	gst_pad_push(wfm->srcpad, outbuf);
+
+	gst_object_unref(wfm);
+	return GST_FLOW_OK;
+}
+
+static void gst_iqwfmstereo_deemphasis(Gst_iqwfmstereo *wfm)
+{
+	if (wfm->deemphasis > 0.0 && wfm->outrate)
+		wfm->dealpha = 1.0 - exp(-1.0 /
+		    (wfm->deemphasis * 1e-6 * wfm->outrate));
+	else
+		wfm->dealpha = 1.0;
+}
+
+/*
+ *	Rates, stages, loop gains and the final low-pass for input 'rate'.
+ *	The multiplex must fit below half the rate, up to 53 kHz, or
+ *	60 kHz with RDS, lower rates are refused.
+ */
+static int gst_iqwfmstereo_setup(Gst_iqwfmstereo *wfm, int rate)
+{
+	double wn, zeta = 0.707, unit = 4294967296.0 / (2.0 * M_PI);
+	float sum = 0.0;
+	int i, taps, need;
+
+	need = wfm->rds ? 60000 : 53000;
+	if (rate < 2 * need)
+		return -1;
+	wfm->rate = rate;
+	for (wfm->mpxrate = rate, wfm->mpxstages = 0;
+	    wfm->mpxstages < WFM_STAGES && !(wfm->mpxrate & 1) &&
+	    wfm->mpxrate * WFM_HBPASS >= need;
+	    wfm->mpxrate /= 2, wfm->mpxstages++);
+	for (wfm->outrate = wfm->mpxrate, wfm->audiostages = 0;
+	    wfm->audiostages < WFM_STAGES && !(wfm->outrate & 1) &&
+	    wfm->outrate >= 76000;
+	    wfm->outrate /= 2, wfm->audiostages++);
+	for (wfm->rdsrate = wfm->mpxrate, wfm->rdsstages = 0;
+	    wfm->rdsstages < WFM_STAGES && !(wfm->rdsrate & 1) &&
+	    wfm->rdsrate >= 24000;
+	    wfm->rdsrate /= 2, wfm->rdsstages++);
+
+	memset(wfm->mpxhb, 0, sizeof(wfm->mpxhb));
+	memset(wfm->sumhb, 0, sizeof(wfm->sumhb));
+	memset(wfm->diffhb, 0, sizeof(wfm->diffhb));
+	memset(wfm->rdsihb, 0, sizeof(wfm->rdsihb));
+	memset(wfm->rdsqhb, 0, sizeof(wfm->rdsqhb));
+
+	/* Second order loop, phase in units of 2^-32 cycle */
+	wn = 2.0 * 2.0 * M_PI * WFM_LOOPBW / (zeta + 1.0 / (4.0 * zeta));
+	wfm->kp = 2.0 * zeta * wn / wfm->mpxrate * unit;
+	wfm->ki = wn * wn / ((double)wfm->mpxrate * wfm->mpxrate) * unit;
+	wfm->step = WFM_PILOT / wfm->mpxrate * 4294967296.0;
+	wfm->pullin = WFM_PULLIN / wfm->mpxrate * 4294967296.0;
+	wfm->erralpha = 1.0 - exp(-2.0 * M_PI * WFM_ERRBW / wfm->mpxrate);
+	wfm->pilotalpha = 1.0 - exp(-2.0 * M_PI * WFM_PILOTBW / wfm->mpxrate);
+	wfm->phase = 0;
+	wfm->integ = 0.0;
+	wfm->err = 0.0;
+	wfm->amp = 0.0;
+	wfm->pilot = 0.0;
+
+	/* 15 kHz low-pass, stopband from the pilot frequency */
+	taps = 5.5 * wfm->outrate / (WFM_PILOT - 15000.0);
+	taps |= 1;
+	free(wfm->fircoef);
+	free(wfm->sumhist);
+	free(wfm->diffhist);
+	wfm->fircoef = malloc(sizeof(float) * taps);
+	wfm->sumhist = calloc(taps * 2, sizeof(float));
+	wfm->diffhist = calloc(taps * 2, sizeof(float));
+	if (!wfm->fircoef || !wfm->sumhist || !wfm->diffhist) {
+		free(wfm->fircoef);
+		free(wfm->sumhist);
+		free(wfm->diffhist);
+		wfm->fircoef = wfm->sumhist = wfm->diffhist = NULL;
+		return -1;
+	}
+	for (i = 0; i < taps; i++) {
+		double x = i - taps / 2;
+		double fc = (15000.0 + WFM_PILOT) / 2.0 / wfm->outrate;
+
+		wfm->fircoef[i] = (x ? sin(2.0 * M_PI * fc * x) / (M_PI * x) :
+		    2.0 * fc) * gst_iqwfmstereo_blackman(i, taps);
+		sum += wfm->fircoef[i];
+	}
+	for (i = 0; i < taps; i++)
+		wfm->fircoef[i] /= sum;
+	wfm->firtaps = taps;
+	wfm->firpos = 0;
+
+	wfm->blend = 0.0;
+	wfm->blendalpha = 1.0 - exp(-1.0 / (0.1 * wfm->outrate));
+	wfm->left = 0.0;
+	wfm->right = 0.0;
+	gst_iqwfmstereo_deemphasis(wfm);
+	return 0;
+}
+
+static gboolean gst_iqwfmstereo_setpadcaps(GstPad *pad, int rate)
+{
+	GstCaps *newcaps;
+	GstStructure *structure;
+	gboolean ret;
+
+	newcaps = gst_caps_copy(gst_pad_get_pad_template_caps(pad));
+	structure = gst_caps_get_structure(newcaps, 0);
+	gst_structure_set(structure, "rate", G_TYPE_INT, rate, NULL);
+	gst_pad_use_fixed_caps(pad);
+	ret = gst_pad_set_caps(pad, newcaps);
+	gst_caps_unref(newcaps);
+	return ret;
+}
+
+static gboolean gst_iqwfmstereo_setcaps(GstPad *pad, GstCaps *caps)
+{
+	Gst_iqwfmstereo *wfm;
+	GstStructure *structure;
+	gboolean ret = FALSE;
+	int rate;
+
+	wfm = GST_IQWFMSTEREO(gst_pad_get_parent(pad));
+
+	structure = gst_caps_get_structure(caps, 0);
+	gst_structure_get_int(structure, "rate", &rate);
+
+	if (!gst_iqwfmstereo_setup(wfm, rate)) {
+		ret = gst_iqwfmstereo_setpadcaps(wfm->srcpad, wfm->outrate);
+		gst_iqwfmstereo_setpadcaps(wfm->rdspad, wfm->rdsrate);
+	}
+
+	gst_object_unref(wfm);
+	return ret;
+}
+
+static void gst_iqwfmstereo_set_property(GObject *object, guint prop_id,
+    const GValue *value, GParamSpec *pspec)
+{
+	Gst_iqwfmstereo *wfm;
+
+	g_return_if_fail(GST_IS_IQWFMSTEREO(object));
+	wfm = GST_IQWFMSTEREO(object);
+
+	switch(prop_id) {
+		case ARG_STEREO:
+			wfm->stereo = g_value_get_boolean(value);
+			break;
+		case ARG_RDS:
+			/* Only before negotiation, it decides the stages */
+			wfm->rds = g_value_get_boolean(value);
+			break;
+		case ARG_DEEMPHASIS:
+			wfm->deemphasis = g_value_get_float(value);
+			gst_iqwfmstereo_deemphasis(wfm);
+			break;
+		default:
+			break;
+	}
+}
+
+static void gst_iqwfmstereo_get_property(GObject *object, guint prop_id,
+    GValue *value, GParamSpec *pspec)
+{
+	Gst_iqwfmstereo *wfm;
+
+	g_return_if_fail(GST_IS_IQWFMSTEREO(object));
+	wfm = GST_IQWFMSTEREO(object);
+
+	switch(prop_id) {
+		case ARG_STEREO:
+			g_value_set_boolean(value, wfm->stereo);
+			break;
+		case ARG_RDS:
+			g_value_set_boolean(value, wfm->rds);
+			break;
+		case ARG_DEEMPHASIS:
+			g_value_set_float(value, wfm->deemphasis);
+			break;
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+			break;
+	}
+}
+
+static GstStateChangeReturn gst_iqwfmstereo_change_state(GstElement *element,
+    GstStateChange transition)
+{
+	return parent_class->change_state(element, transition);
+}
+
+static void gst_iqwfmstereo_class_init(Gst_iqwfmstereo_class *klass)
+{
+	GObjectClass *gobject_class;
+	GstElementClass *gstelement_class;
+
+	gobject_class = (GObjectClass *) klass;
+	gstelement_class = (GstElementClass *) klass;
+
+	parent_class = g_type_class_ref(GST_TYPE_ELEMENT);
+
+	gst_iqwfmstereo_tables();
+
+	gobject_class->set_property = gst_iqwfmstereo_set_property;
+	gobject_class->get_property = gst_iqwfmstereo_get_property;
+
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_STEREO,
+	    g_param_spec_boolean("stereo", "stereo",
+	    "decode stereo when there is a pilot",
+	    TRUE, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_RDS,
+	    g_param_spec_boolean("rds", "rds",
+	    "output the RDS subcarrier on the rds pad",
+	    FALSE, G_PARAM_READWRITE));
+	g_object_class_install_property(G_OBJECT_CLASS(klass), ARG_DEEMPHASIS,
+	    g_param_spec_float("deemphasis", "deemphasis",
+	    "de-emphasis time constant in us (50 or 75), 0 for none",
+	    0.0, G_MAXFLOAT, 50.0, G_PARAM_READWRITE));
+
+	gstelement_class->change_state = gst_iqwfmstereo_change_state;
+
+	gst_element_class_set_details(gstelement_class, &iqwfmstereo_details);
+
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&sink_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&src_template));
+	gst_element_class_add_pad_template(gstelement_class,
+	    gst_static_pad_template_get(&rds_template));
+}
+
+static void gst_iqwfmstereo_init(Gst_iqwfmstereo *wfm)
+{
+	wfm->sinkpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&sink_template), "sink");
+
+	gst_pad_set_chain_function(wfm->sinkpad, gst_iqwfmstereo_chain);
+	gst_pad_set_setcaps_function(wfm->sinkpad, gst_iqwfmstereo_setcaps);
+	gst_element_add_pad(GST_ELEMENT(wfm), wfm->sinkpad);
+
+	wfm->srcpad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&src_template), "src");
+	gst_element_add_pad(GST_ELEMENT(wfm), wfm->srcpad);
+
+	wfm->rdspad = gst_pad_new_from_template(
+	    gst_static_pad_template_get(&rds_template), "rds");
+	gst_element_add_pad(GST_ELEMENT(wfm), wfm->rdspad);
+
+	wfm->stereo = TRUE;
+	wfm->rds = FALSE;
+	wfm->deemphasis = 50.0;
+	wfm->rate = 0;
+	wfm->outrate = 0;
+	wfm->fircoef = NULL;
+	wfm->sumhist = NULL;
+	wfm->diffhist = NULL;
+	wfm->work = NULL;
+	wfm->worksize = 0;
+	wfm->offset = 0;
+	wfm->rdsoffset = 0;
+}
+
+GType gst_iqwfmstereo_get_type(void)
+{
+	static GType iqwfmstereo_type = 0;
+
+	if (!iqwfmstereo_type) {
+		static const GTypeInfo iqwfmstereo_info = {
+			sizeof(Gst_iqwfmstereo_class),
+			NULL,
+			NULL,
+			(GClassInitFunc)gst_iqwfmstereo_class_init,
+			NULL,
+			NULL,
+			sizeof(Gst_iqwfmstereo),
+			0,
+			(GInstanceInitFunc)gst_iqwfmstereo_init,
+		};
+		iqwfmstereo_type = g_type_register_static(GST_TYPE_ELEMENT,
+		    "GstIQWFMStereo", &iqwfmstereo_info, 0);
+	}
+	return iqwfmstereo_type;
+}
@@ -0,0 +1,69 @@
+/*
+ *	FFT windows.
+ *
+ *	Copyright agent (agent@local), 2026
+ *
+ *	This software is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License as
+ *	published by the Free Software Foundation; either version 2 of
+ *	the License, or (at your option) any later version.
+ */
+
+/*
+ *	Windows for overlapping frames, shared by the forward and reverse
+ *	FFT elements. cmplxfft multiplies each frame with the analysis
+ *	window, cmplxrfft multiplies the inverse transform with the
+ *	synthesis window and overlap-adds frames that are length/overlap
+ *	samples apart.
+ *	The synthesis window is normalized so that the analysis and
+ *	synthesis windows together overlap-add to one. An unmodified
+ *	spectrum is then reconstructed exactly.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "gstiq.h"
+
+float *iqwindow_analysis(int type, int length)
+{
+	float *window;
+	int i;
+
+	window = malloc(sizeof(float) * length);
+	if (!window)
+		return NULL;
+	for (i = 0; i < length; i++) {
+		switch (type) {
+			case WINDOW_SQRTHANN:
+				/* periodic, so shifted copies add up evenly */
+				window[i] = sin(M_PI * i / length);
+				break;
+			case WINDOW_RECTANGULAR:
+			default:
+				window[i] = 1.0;
+				break;
+		}
+	}
+	return window;
+}
+
+float *iqwindow_synthesis(int type, int length, int overlap)
+{
+	float *window;
+	double sum;
+	int hop = length / overlap;
+	int i, j;
+
+	window = iqwindow_analysis(type, length);
+	if (!window)
+		return NULL;
+	for (i = 0; i < hop; i++) {
+		sum = 0.0;
+		for (j = i; j < length; j += hop)
+			sum += window[j] * window[j];
+		/* Positions no frame covers (sqrt-hann without overlap) */
+		for (j = i; j < length; j += hop)
+			window[j] = sum > 1e-6 ? window[j] / sum : 0.0;
+	}
+	return window;
+}